@@ -0,0 +1,79 @@
+#!/usr/bin/env python3
+"""Generates SUBC functions with thousands of basic blocks, for 'p1 -cfg'.
+
+Usage: python3 bench/gen_blocks.py NUM_STATEMENTS [NUM_FUNCTIONS] [SEED] > blocks.subc
+
+Each function has NUM_STATEMENTS statements nested up to four deep, drawn
+from every form that adds blocks or edges (if, while, repeat, for,
+loop/exit, case), over 40 locals so the bit vectors span several words.
+"""
+import random
+import sys
+
+NAMES = ['v%d' % i for i in range(40)]
+
+
+def expression(rng):
+    a, b = rng.choice(NAMES), rng.choice(NAMES + [str(rng.randint(0, 99))])
+    return '%s %s %s' % (a, rng.choice(['+', '-', '*']), b)
+
+
+def condition(rng):
+    return '%s %s %s' % (rng.choice(NAMES), rng.choice(['<', '>', '=', '<>']), expression(rng))
+
+
+def statement(rng, budget, depth, in_loop):
+    """Returns (text, statements used)."""
+    if budget <= 1 or depth >= 4 or rng.random() < 0.35:
+        if in_loop and rng.random() < 0.05:
+            return 'exit', 1
+        return '%s := %s' % (rng.choice(NAMES), expression(rng)), 1
+    kind = rng.choice(['if', 'while', 'repeat', 'for', 'loop', 'case'])
+    inner_loop = in_loop or kind == 'loop'
+    parts, used = [], 1
+    for _ in range(rng.randint(1, 3)):
+        text, n = statement(rng, (budget - used) // 2, depth + 1, inner_loop)
+        parts.append(text)
+        used += n
+        if used >= budget:
+            break
+    body = 'begin %s end' % '; '.join(parts)
+    if kind == 'if':
+        return 'if %s then %s else %s' % (condition(rng), body, parts[0]), used
+    if kind == 'while':
+        return 'while %s do %s' % (condition(rng), body), used
+    if kind == 'repeat':
+        return 'repeat %s until %s' % ('; '.join(parts), condition(rng)), used
+    if kind == 'for':
+        v = rng.choice(NAMES)
+        return 'for (%s := 0; %s < 10; %s := %s + 1) %s' % (v, v, v, v, body), used
+    if kind == 'loop':
+        return 'loop %s; if %s then exit pool' % ('; '.join(parts), condition(rng)), used
+    clauses = ['%d: %s' % (i, p) for i, p in enumerate(parts)]
+    return 'case %s of %s; otherwise %s end' % (rng.choice(NAMES), '; '.join(clauses), parts[0]), used
+
+
+def function(rng, index, size):
+    body, used = [], 0
+    while used < size:
+        text, n = statement(rng, size - used, 0, False)
+        body.append(text)
+        used += n
+    return ('function f%d ( a : integer ) : integer;\nvar %s : integer;\n'
+            'begin\n    %s;\n    return (%s)\nend f%d;\n\n'
+            % (index, ', '.join(NAMES), ';\n    '.join(body), ' + '.join(NAMES[:8]), index))
+
+
+def main():
+    size = int(sys.argv[1])
+    count = int(sys.argv[2]) if len(sys.argv) > 2 else 1
+    rng = random.Random(int(sys.argv[3]) if len(sys.argv) > 3 else 1)
+    out = ['program blocks:\nvar n : integer;\n\n']
+    for i in range(count):
+        out.append(function(rng, i, size))
+    out.append('begin\n    read(n);\n    output (f0(n))\nend blocks.\n')
+    sys.stdout.write(''.join(out))
+
+
+if __name__ == '__main__':
+    main()
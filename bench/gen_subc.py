@@ -0,0 +1,65 @@
+#!/usr/bin/env python3
+"""Generates a large, valid SUBC program for benchmarking p1.
+
+Usage: python3 bench/gen_subc.py NUM_FUNCTIONS [SEED] > big.subc
+
+Each function mixes every statement form the parser knows, plus comments,
+char and string literals, so the scanner and parser see realistic input.
+"""
+import random
+import sys
+
+
+def expression(rng, names, depth=0):
+    if depth > 2 or rng.random() < 0.3:
+        return rng.choice(names + [str(rng.randint(0, 999))])
+    op = rng.choice(['+', '-', '*', '/', 'mod', '+', '*'])
+    return '(%s %s %s)' % (expression(rng, names, depth + 1), op,
+                           expression(rng, names, depth + 1))
+
+
+def condition(rng, names):
+    op = rng.choice(['<', '<=', '>', '>=', '=', '<>'])
+    return '%s %s %s' % (expression(rng, names), op, expression(rng, names))
+
+
+def function(rng, index, callees):
+    name = 'f%d' % index
+    names = ['a', 'b', 'i', 'j']
+    call = 'a'
+    if callees:
+        call = '%s(%s, b)' % (rng.choice(callees), expression(rng, names))
+    body = [
+        'i := %s' % expression(rng, names),
+        'if %s then j := %s else j := %s' % (condition(rng, names), call, expression(rng, names)),
+        'while %s do i := i - 1' % condition(rng, names),
+        'for (j := 0; j < %d; j := j + 1) output (j, \'%s\')' % (rng.randint(1, 9), rng.choice('xyz')),
+        'repeat i := succ(i); b := pred(b) until %s' % condition(rng, names),
+        'loop if i > 10 then exit; i := i + 1 pool',
+        'case i of 0: j := 1; 1..5: j := 2; 6, 7: j := 3; otherwise j := 4 end',
+        'output ("%s", %s)' % (name, expression(rng, names)),
+        'i :=: j',
+    ]
+    rng.shuffle(body)
+    return ('{ generated function %d }\n'
+            'function %s ( a, b : integer ) : integer;\n'
+            'type\n    K%d = ( R%d, G%d, B%d );\n'
+            'var\n    i, j : integer;\n    k : K%d;\n'
+            'begin\n    %s;\n    return (%s)  # done\nend %s;\n\n'
+            % (index, name, index, index, index, index, index,
+               ';\n    '.join(body), expression(rng, names), name))
+
+
+def main():
+    count = int(sys.argv[1])
+    rng = random.Random(int(sys.argv[2]) if len(sys.argv) > 2 else 1)
+    out = ['program big:\nvar n : integer;\n\n']
+    for i in range(count):
+        callees = ['f%d' % k for k in range(max(0, i - 8), i)]
+        out.append(function(rng, i, callees))
+    out.append('begin\n    read(n);\n    output (f%d(n, 3))\nend big.\n' % (count - 1))
+    sys.stdout.write(''.join(out))
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,56 @@
+#!/usr/bin/env python3
+"""Times 'p1 -batch' on cold files with and without readahead.
+
+Usage: python3 bench/readahead_bench.py [NUM_FILES] [FUNCTIONS_PER_FILE] [DIR]
+
+Writes NUM_FILES programs from gen_subc.py into DIR (default: a temporary
+directory on the same disk as this repository, since a RAM-backed /tmp
+has no cold reads), then for each configuration drops them from the page
+cache with posix_fadvise(POSIX_FADV_DONTNEED) and runs p1 -batch on them,
+printing the wall time and p1's own overlap line.
+"""
+import os
+import shutil
+import subprocess
+import sys
+import tempfile
+import time
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+P1 = os.path.join(HERE, '..', 'p1')
+CONFIGS = [['-batch0'], ['-batch16'], ['-batch16', '-threads'], ['-batch64']]
+
+
+def evict(paths):
+    for path in paths:
+        fd = os.open(path, os.O_RDONLY)
+        os.fsync(fd)
+        os.posix_fadvise(fd, 0, 0, os.POSIX_FADV_DONTNEED)
+        os.close(fd)
+
+
+def main():
+    num_files = int(sys.argv[1]) if len(sys.argv) > 1 else 400
+    functions = int(sys.argv[2]) if len(sys.argv) > 2 else 20
+    workdir = sys.argv[3] if len(sys.argv) > 3 else tempfile.mkdtemp(dir=os.path.join(HERE, '..'))
+    paths = []
+    for i in range(num_files):
+        path = os.path.join(workdir, 'f%05d.subc' % i)
+        with open(path, 'w') as f:
+            subprocess.run([sys.executable, os.path.join(HERE, 'gen_subc.py'), str(functions), str(i)],
+                           stdout=f, check=True)
+        paths.append(path)
+    try:
+        for args in CONFIGS:
+            evict(paths)
+            start = time.perf_counter()
+            out = subprocess.run([P1] + args + paths, capture_output=True, text=True).stdout
+            print('%-20s %7.1f ms  %s' % (' '.join(args), 1000 * (time.perf_counter() - start),
+                                         out.strip().splitlines()[-1]))
+    finally:
+        if len(sys.argv) <= 3:
+            shutil.rmtree(workdir)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,84 @@
+#!/usr/bin/env python3
+"""Compares per-request latency of a warm 'p1 -serve' against fork/exec of p1.
+
+Usage: python3 bench/server_bench.py PROGRAM [REQUESTS] [CLIENTS]
+
+Starts a server on a temporary socket, then times REQUESTS parses of
+PROGRAM three ways: spawning './p1 -ast', sending the path to the server,
+and sending the path to the server from CLIENTS threads at once.
+"""
+import os
+import socket
+import subprocess
+import sys
+import tempfile
+import threading
+import time
+
+P1 = os.path.join(os.path.dirname(os.path.abspath(__file__)), '..', 'p1')
+
+
+def request(path, fmt, kind, payload):
+    s = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+    s.connect(path)
+    s.sendall(b'%s %s %d\n' % (fmt, kind, len(payload)) + payload)
+    data = b''
+    while True:
+        chunk = s.recv(1 << 16)
+        if not chunk:
+            break
+        data += chunk
+    s.close()
+    header, _, body = data.partition(b'\n')
+    assert header.startswith(b'ok '), data[:200]
+    return body
+
+
+def report(name, seconds, count):
+    print('%-24s %9.1f us/request' % (name, seconds / count * 1e6))
+
+
+def main():
+    program = os.path.abspath(sys.argv[1])
+    count = int(sys.argv[2]) if len(sys.argv) > 2 else 200
+    clients = int(sys.argv[3]) if len(sys.argv) > 3 else 4
+    sock = os.path.join(tempfile.mkdtemp(), 'p1.sock')
+    server = subprocess.Popen([P1, '-serve', sock])
+    while not os.path.exists(sock):
+        time.sleep(0.01)
+
+    expected = subprocess.run([P1, '-ast', program], capture_output=True).stdout
+    start = time.time()
+    for _ in range(count):
+        subprocess.run([P1, '-ast', program], stdout=subprocess.DEVNULL)
+    report('fork/exec p1 -ast', time.time() - start, count)
+
+    assert request(sock, b'ast', b'path', program.encode()) == expected
+    start = time.time()
+    for _ in range(count):
+        request(sock, b'ast', b'path', program.encode())
+    report('server, 1 client', time.time() - start, count)
+
+    def worker():
+        for _ in range(count // clients):
+            assert request(sock, b'ast', b'path', program.encode()) == expected
+    threads = [threading.Thread(target=worker) for _ in range(clients)]
+    start = time.time()
+    for t in threads:
+        t.start()
+    for t in threads:
+        t.join()
+    report('server, %d clients' % clients, time.time() - start, count // clients * clients)
+
+    source = open(program, 'rb').read()
+    start = time.time()
+    for i in range(count):
+        request(sock, b'check', b'source', source + b' ' * i)
+    report('server, uncached check', time.time() - start, count)
+
+    request(sock, b'shutdown', b'path', b'')
+    server.wait()
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,188 @@
+#!/usr/bin/env python3
+"""Worst-case inputs for the scanner and parser, checked for linear scaling.
+
+Usage: python3 bench/stress.py [SCALE]
+
+Each case generates an adversarial program at four sizes, doubling each
+time, and runs p1 on it. The slope of log(time) and log(peak memory)
+against log(size) is fitted by least squares; a case fails if either slope
+exceeds MAX_SLOPE (a linear cost fits 1.0, a quadratic one 2.0), if p1
+dies from a signal other than an uncaught exception, or if it accepts or
+rejects the program other than expected. SCALE (default 1) multiplies
+every size. Exits 1 if any case fails.
+
+Timings of a few milliseconds are mostly noise, so a case whose largest
+size runs in under MIN_SECONDS past p1's startup gets no time slope, and
+one that peaks under MIN_KB above it no memory slope; the case says so
+rather than pass or fail on that count. Raise SCALE for them.
+script.bash does not run this suite, since it takes about a minute: run
+it by hand after changing the scanner or parser.
+"""
+import ctypes
+import math
+import os
+import signal
+import subprocess
+import sys
+import tempfile
+import time
+
+P1 = os.path.join(os.path.dirname(os.path.abspath(__file__)), '..', 'p1')
+MAX_SLOPE = 1.3
+MIN_SECONDS = 0.05
+MIN_KB = 4096
+RUNS = 3
+
+MAIN = 'begin\nend a.\n'
+
+LIBC = ctypes.CDLL(None, use_errno=True)
+PTRACE_TRACEME, PTRACE_CONT, PTRACE_SETOPTIONS = 0, 7, 0x4200
+PTRACE_O_TRACEEXIT, PTRACE_EVENT_EXIT = 0x40, 6
+
+
+def program(decls='', body='x := 1'):
+    return 'program a:\nvar x: integer;\n%sbegin\n%s\nend a.\n' % (decls, body)
+
+
+def nests(open_, close, depth, copies=400):
+    """'copies' statements, each nested 'depth' levels deep."""
+    return ';\n'.join(open_ * depth + 'x := 1' + close * depth for _ in range(copies))
+
+
+def function(i):
+    return ('function f%d(a: integer): integer;\nbegin\n'
+            '  if a > 0 then return (f%d(a - 1)) else return (%d)\nend f%d;\n' % (i, i, i, i))
+
+
+# name, p1 arguments, generator, base size, expected error (None = accepted)
+CASES = [
+    ('huge comment', [], lambda n: 'program a:\n{' + 'x' * n + '}\n' + MAIN, 1000000, None),
+    ('huge # comment', [], lambda n: 'program a:\n#' + 'x' * n + '\n' + MAIN, 1000000, None),
+    ('consecutive comments', [], lambda n: 'program a:\n' + '{c}' * n + '\n' + MAIN, 250000, None),
+    ('consecutive # comments', [], lambda n: 'program a:\n' + '# c\n' * n + MAIN, 250000, None),
+    ('long identifier', [], lambda n: 'program %s:\nbegin\nend %s.\n' % ('a' * n, 'a' * n), 500000, None),
+    ('long string', [], lambda n: program(body='output ("%s")' % ('x' * n)), 1000000, None),
+    ('long integer', [], lambda n: program(body='x := ' + '9' * n), 1000000, 'does not fit'),
+    ('unterminated comment', [], lambda n: 'program a:\n{' + 'x' * n, 1000000,
+     "Comment is not closed"),
+    ('unterminated string', [], lambda n: 'program a:\nbegin output ("' + 'x' * n, 1000000,
+     'Literal is not closed'),
+    ('statement chain', [], lambda n: program(body='x := 1;\n' * n + 'x := 1'), 50000, None),
+    ('statement chain -ast', ['-ast'], lambda n: program(body='x := 1;\n' * n + 'x := 1'), 25000, None),
+    ('long operator chain', [], lambda n: program(body='x := ' + ' + '.join(['1'] * n)), 50000, None),
+    ('long operator chain -run', ['-run'], lambda n: program(body='x := ' + ' + '.join(['1'] * n)), 50000, None),
+    ('long expressions', [], lambda n: program(body=';\n'.join(['x := 1' + ' + x * 2' * 1000] * n)), 10, None),
+    ('nested parentheses', [], lambda n: program(body=nests('', '', 0).replace('1', '(' * n + '1' + ')' * n)),
+     250, None),
+    ('nested begin', [], lambda n: program(body=nests('begin ', ' end', n)), 250, None),
+    ('nested if', [], lambda n: program(body=nests('if x = 0 then ', '', n)), 250, None),
+    ('nested case', [], lambda n: program(body=nests('case x of 1: ', '; end', n)), 250, None),
+    ('nesting past the limit', [], lambda n: program(body='x := ' + '(' * n + '1' + ')' * n), 125000,
+     'nested more than'),
+    ('functions -j4', ['-j4'], lambda n: 'program a:\n' + ''.join(function(i) for i in range(n)) + MAIN,
+     5000, None),
+    ('comment across chunks -tokens -j4', ['-tokens', '-j4'],
+     lambda n: 'program a:\n{' + 'x\'"\n' * n + '}\n' + MAIN, 250000, None),
+    ('lazy bodies -sigs', ['-sigs'], lambda n: 'program a:\n' + ''.join(function(i) for i in range(n)) + MAIN,
+     5000, None),
+    ('type check -types -j4', ['-types', '-j4'],
+     lambda n: 'program a:\n' + ''.join(function(i) for i in range(n)) + MAIN, 5000, None),
+]
+
+
+def peak_kb(pid):
+    with open('/proc/%d/status' % pid) as f:
+        for line in f:
+            if line.startswith('VmHWM:'):
+                return int(line.split()[1])
+    return 0
+
+
+def run(args, path):
+    """Returns (seconds, peak KB, return code, stderr) for one run of p1.
+
+    The peak is read from /proc while p1 is stopped on its way out, under
+    ptrace: getrusage() would also count the harness's own memory, which a
+    forked child inherits as its starting peak."""
+    with open(os.devnull, 'wb') as null, tempfile.TemporaryFile() as err:
+        start = time.perf_counter()
+        proc = subprocess.Popen([P1] + args + [path], stdout=null, stderr=err,
+                                preexec_fn=lambda: LIBC.ptrace(PTRACE_TRACEME, 0, None, None))
+        pid, kb = proc.pid, 0
+        os.waitpid(pid, 0)                  # stopped after exec
+        LIBC.ptrace(PTRACE_SETOPTIONS, pid, None, ctypes.c_void_p(PTRACE_O_TRACEEXIT))
+        LIBC.ptrace(PTRACE_CONT, pid, None, None)
+        while True:
+            _, status = os.waitpid(pid, 0)
+            if not os.WIFSTOPPED(status):
+                break
+            sig = os.WSTOPSIG(status)
+            if sig == signal.SIGTRAP and status >> 16 == PTRACE_EVENT_EXIT:
+                kb, sig = peak_kb(pid), 0
+            LIBC.ptrace(PTRACE_CONT, pid, None, ctypes.c_void_p(sig))
+        seconds = time.perf_counter() - start
+        proc.returncode = -os.WTERMSIG(status) if os.WIFSIGNALED(status) else os.WEXITSTATUS(status)
+        err.seek(0)
+        return seconds, kb, proc.returncode, err.read(2000).decode('utf-8', 'replace')
+
+
+def slope(xs, ys):
+    lx = [math.log(x) for x in xs]
+    ly = [math.log(y) for y in ys]
+    mx, my = sum(lx) / len(lx), sum(ly) / len(ly)
+    return sum((a - mx) * (b - my) for a, b in zip(lx, ly)) / sum((a - mx) ** 2 for a in lx)
+
+
+def main():
+    scale = float(sys.argv[1]) if len(sys.argv) > 1 else 1.0
+    workdir = tempfile.mkdtemp()
+    path = os.path.join(workdir, 'stress.subc')
+    with open(path, 'w') as f:
+        f.write(program())
+    base_seconds = min(run([], path)[0] for _ in range(RUNS))
+    base_kb = run([], path)[1]
+
+    failures = 0
+    print('%-36s %10s %10s %10s %10s' % ('case', 'max size', 'max time', 'time slope', 'mem slope'))
+    for name, args, generate, base, expect in CASES:
+        sizes, times, kbs, problems, notes = [], [], [], [], []
+        for step in range(4):
+            n = max(1, int(base * scale)) << step
+            text = generate(n)
+            with open(path, 'w') as f:
+                f.write(text)
+            sizes.append(len(text))
+            del text
+            best, peak = None, 0
+            for _ in range(RUNS):
+                seconds, kb, code, err = run(args, path)
+                best = seconds if best is None else min(best, seconds)
+                peak = max(peak, kb)
+            if code < 0 and code != -6:      # an uncaught exception aborts
+                problems.append('signal %d at size %d' % (-code, n))
+            elif expect is None and code != 0:
+                problems.append('rejected at size %d: %s' % (n, err.strip()[:120]))
+            elif expect is not None and expect not in err:
+                problems.append('not rejected with "%s" at size %d' % (expect, n))
+            times.append(max(best - base_seconds, 1e-4))
+            kbs.append(max(peak - base_kb, 256))
+        time_slope, mem_slope = slope(sizes, times), slope(sizes, kbs)
+        if times[-1] < MIN_SECONDS:
+            notes.append('too fast for a time slope')
+        elif time_slope > MAX_SLOPE:
+            problems.append('time grows as size^%.2f' % time_slope)
+        if kbs[-1] < MIN_KB:
+            notes.append('too small for a memory slope')
+        elif mem_slope > MAX_SLOPE:
+            problems.append('memory grows as size^%.2f' % mem_slope)
+        print('%-36s %10d %9.3fs %10.2f %10.2f  %s'
+              % (name, sizes[-1], times[-1], time_slope, mem_slope,
+                 'FAIL: ' + '; '.join(problems) if problems else '; '.join(notes) or 'ok'))
+        failures += bool(problems)
+    os.remove(path)
+    os.rmdir(workdir)
+    return 1 if failures else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,697 @@
+// ll1gen: generates the LL(1) parsing tables of subc_ll1.h from the grammar
+// in docs/grammar.txt, for Parse_Table_Source() in subc.cpp.
+//
+//     ll1gen docs/grammar.txt subc_ll1.h
+//
+// The grammar is EBNF: a rule is a name and its alternatives, each written
+// '-> items [=> "label"]', and ends with ';'. An item is a 'terminal', a
+// rule name or a (group), followed by any of '*', '+', '?' or 'list' and a
+// separating 'terminal'. An alternative with a label builds a node of that
+// label over the trees its items built, at the offset of its first token
+// if it starts with one; the others leave those trees as they are.
+// Terminals spelled like '<identifier>' stand for a class of tokens and
+// build a leaf each.
+//
+// The grammar is lowered to BNF, with a helper rule for each repetition,
+// then left recursion is removed and common prefixes are factored out, as
+// the grammar has both ('Term -> Term '+' Factor', 'Assignment -> Name
+// ...'). A label moved past trees that were built before it counts them
+// into its node. FIRST and FOLLOW sets then give the table. A conflict
+// between an empty alternative and another is settled for the other one,
+// so an 'else' belongs to the nearest 'if'; any other conflict is an error,
+// and the output is only written if there was none.
+#include <iostream>         // cerr
+#include <fstream>          // ifstream, ofstream
+#include <sstream>          // stringstream
+#include <string>           // string
+#include <vector>           // vector
+#include <set>              // set
+#include <stdexcept>        // runtime_error
+#include <cctype>           // isspace, isalnum
+
+using std::string;
+using std::vector;
+using std::set;
+using std::runtime_error;
+using std::to_string;
+
+
+
+/**************************** CONSTRUCTS ****************************/
+// An item of an alternative as written: a terminal, a rule, or a group of
+// items, repeated as 'repeat' says.
+struct Item {
+    enum Kind { TERMINAL, RULE, GROUP } kind;
+    int id;                 // terminal or rule
+    vector<Item> group;
+    char repeat;            // 0, '*', '+', '?' or 'l' for 'list'
+    int separator;          // terminal between the elements of a list
+};
+struct Alternative {
+    vector<Item> items;
+    int label;              // -1 if it builds no node
+};
+struct Rule {
+    string name;
+    vector<Alternative> alternatives;
+    int line;               // where it is defined, 0 until then
+};
+// A symbol of the BNF grammar.
+struct Symbol {
+    bool terminal;
+    int id;
+    bool operator==(const Symbol& s) const { return terminal == s.terminal && id == s.id; }
+    bool operator!=(const Symbol& s) const { return !(*this == s); }
+};
+// A BNF alternative: [mark] symbols [build] after. A labeled one marks
+// where its trees start, then builds them and 'extra' trees from before
+// the mark into a node; 'here' puts the node at the offset of the token at
+// the mark rather than its first child's. 'after' follows the build, for
+// the tail of a rule whose left recursion was removed.
+struct Production {
+    vector<Symbol> symbols;
+    int label;
+    int extra;
+    bool here;
+    vector<Symbol> after;
+};
+// A nonterminal of the BNF grammar: a rule of the grammar, or a helper
+// made for one, which reports errors under the rule's name.
+struct Nonterminal {
+    string name;
+    string rule;
+    vector<Production> productions;
+};
+// How many trees a nonterminal builds: a count, or one of these.
+const int Unknown = -1, Varies = -2;
+
+
+
+/**************************** FD ****************************/
+void Read_Grammar(const string& path);
+[[noreturn]] void Grammar_Error(int line, const string& msg);
+void Skip_Space();
+bool Accept(const string& s);
+void Expect(const string& s);
+string Word();
+string Quoted(char quote);
+vector<Item> Items();
+char Postfix();
+int Terminal_Id(const string& spelling);
+int Rule_Id(const string& name);
+int Label_Id(const string& label);
+void Lower();
+vector<Symbol> Lower_Items(const vector<Item>& items, int owner);
+int Helper(int owner);
+void Count_Trees();
+int Count_Symbols(const vector<Symbol>& symbols);
+bool Is_Class(int t);
+int Join(int a, int b);
+void Remove_Left_Recursion(int a);
+bool Factor_Prefix(int a);
+vector<Symbol> Sequence(const Production& p);
+void Compute_First_Follow();
+set<int> First_Of(const vector<Symbol>& symbols, size_t from, bool& nullable);
+void Build_Table();
+string Describe(int a, const Production& p);
+string C_String(const string& s);
+string Generate(const string& grammar_path);
+
+
+
+/**************************** GLOBALS ****************************/
+string Grammar_Path;
+string Text;
+size_t At = 0;
+int Line = 1;
+vector<string> Terminals;
+int Eof;                            // the terminal after the last token
+vector<Rule> Rules;
+vector<string> Labels;
+vector<Nonterminal> Nonterminals;   // Nonterminals[r] is Rules[r]
+vector<int> Trees;                  // by nonterminal
+vector<bool> Nullable;
+vector<set<int>> First, Follow;
+vector<std::pair<int, int>> Numbered;   // (nonterminal, index) of each production
+vector<vector<int>> Table;          // [nonterminal][terminal]: production, or -1
+vector<string> Settled;             // conflicts settled for the nonempty side
+
+
+
+/**************************** READING ****************************/
+
+[[noreturn]] void Grammar_Error(int line, const string& msg) {
+    throw runtime_error(Grammar_Path + ":" + to_string(line) + ": " + msg);
+}
+
+void Read_Grammar(const string& path) {
+    std::ifstream in(path);
+    if (!in)
+        throw runtime_error("Failed to open " + path + ".");
+    std::stringstream buffer;
+    buffer << in.rdbuf();
+    Text = buffer.str();
+    Grammar_Path = path;
+    Skip_Space();
+    while (At < Text.size()) {
+        int line = Line;
+        int r = Rule_Id(Word());
+        if (Rules[r].line)
+            Grammar_Error(line, "Rule '" + Rules[r].name + "' is defined twice.");
+        Rules[r].line = line;
+        if (Text.compare(At, 2, "->") != 0)
+            Grammar_Error(Line, "Expected '->'.");
+        while (Accept("->")) {
+            Alternative alt{Items(), -1};
+            if (Accept("=>"))
+                alt.label = Label_Id(Quoted('"'));
+            Rules[r].alternatives.push_back(alt);
+        }
+        Expect(";");
+    }
+    if (Rules.empty())
+        Grammar_Error(Line, "The grammar has no rules.");
+    for (const Rule& r : Rules)
+        if (!r.line)
+            Grammar_Error(Line, "Rule '" + r.name + "' is used but never defined.");
+    Eof = Terminal_Id("<eof>");
+}
+
+void Skip_Space() {
+    while (At < Text.size() && isspace((unsigned char) Text[At]))
+        if (Text[At++] == '\n')
+            Line++;
+}
+
+bool Accept(const string& s) {
+    if (Text.compare(At, s.size(), s) != 0)
+        return false;
+    At += s.size();
+    Skip_Space();
+    return true;
+}
+
+void Expect(const string& s) {
+    if (!Accept(s))
+        Grammar_Error(Line, "Expected '" + s + "'.");
+}
+
+string Word() {
+    size_t start = At;
+    while (At < Text.size() && (isalnum((unsigned char) Text[At]) || Text[At] == '_'))
+        At++;
+    if (At == start)
+        Grammar_Error(Line, "Expected a rule name.");
+    string word = Text.substr(start, At - start);
+    Skip_Space();
+    return word;
+}
+
+string Quoted(char quote) {
+    if (At >= Text.size() || Text[At] != quote)
+        Grammar_Error(Line, string("Expected a string in ") + quote + "quotes" + quote + ".");
+    size_t end = Text.find(quote, At + 1);
+    if (end == string::npos || Text.find('\n', At) < end)
+        Grammar_Error(Line, "Quoted string is not closed.");
+    string s = Text.substr(At + 1, end - At - 1);
+    At = end + 1;
+    Skip_Space();
+    return s;
+}
+
+// The items of an alternative or group, up to the '=>', '->', ';' or ')'
+// that ends it.
+vector<Item> Items() {
+    vector<Item> items;
+    while (At < Text.size() && Text[At] != ';' && Text[At] != ')' &&
+           Text.compare(At, 2, "->") != 0 && Text.compare(At, 2, "=>") != 0) {
+        Item item{Item::TERMINAL, -1, {}, 0, -1};
+        if (Text[At] == '\'') {
+            item.id = Terminal_Id(Quoted('\''));
+        } else if (Accept("(")) {
+            item.kind = Item::GROUP;
+            item.group = Items();
+            Expect(")");
+            if (item.group.empty())
+                Grammar_Error(Line, "Group is empty.");
+        } else {
+            item.kind = Item::RULE;
+            item.id = Rule_Id(Word());
+        }
+        for (char op = Postfix(); op; op = Postfix()) {
+            if (item.repeat)
+                item = Item{Item::GROUP, -1, {item}, 0, -1};
+            item.repeat = op;
+            if (op == 'l')
+                item.separator = Terminal_Id(Quoted('\''));
+        }
+        items.push_back(item);
+    }
+    return items;
+}
+
+// Reads a '*', '+', '?' or 'list' after an item, or returns 0.
+char Postfix() {
+    if (At < Text.size() && (Text[At] == '*' || Text[At] == '+' || Text[At] == '?')) {
+        char op = Text[At++];
+        Skip_Space();
+        return op;
+    }
+    if (Text.compare(At, 4, "list") == 0 && (At + 4 == Text.size() || !isalnum((unsigned char) Text[At + 4]))) {
+        Accept("list");
+        return 'l';
+    }
+    return 0;
+}
+
+int Terminal_Id(const string& spelling) {
+    for (size_t t = 0; t < Terminals.size(); ++t)
+        if (Terminals[t] == spelling)
+            return (int) t;
+    Terminals.push_back(spelling);
+    return (int) Terminals.size() - 1;
+}
+
+int Rule_Id(const string& name) {
+    for (size_t r = 0; r < Rules.size(); ++r)
+        if (Rules[r].name == name)
+            return (int) r;
+    Rules.push_back(Rule{name, {}, 0});
+    return (int) Rules.size() - 1;
+}
+
+int Label_Id(const string& label) {
+    for (size_t l = 0; l < Labels.size(); ++l)
+        if (Labels[l] == label)
+            return (int) l;
+    Labels.push_back(label);
+    return (int) Labels.size() - 1;
+}
+
+
+
+/**************************** LOWERING ****************************/
+
+void Lower() {
+    for (const Rule& r : Rules)
+        Nonterminals.push_back(Nonterminal{r.name, r.name, {}});
+    for (size_t r = 0; r < Rules.size(); ++r)
+        for (const Alternative& alt : Rules[r].alternatives) {
+            const vector<Item>& items = alt.items;
+            bool here = alt.label >= 0 && !items.empty() && items[0].kind == Item::TERMINAL && !items[0].repeat;
+            Production p{Lower_Items(items, (int) r), alt.label, 0, here, {}};
+            Nonterminals[r].productions.push_back(p);
+        }
+}
+
+// The symbols for 'items', with a helper nonterminal for each repetition:
+// X* is H -> X H | (empty), X+ is X H, X? is H -> X | (empty), and X list s
+// is X H where H -> s X H | (empty).
+vector<Symbol> Lower_Items(const vector<Item>& items, int owner) {
+    vector<Symbol> out;
+    for (const Item& item : items) {
+        vector<Symbol> one;
+        if (item.kind == Item::TERMINAL)
+            one.push_back(Symbol{true, item.id});
+        else if (item.kind == Item::RULE)
+            one.push_back(Symbol{false, item.id});
+        else
+            one = Lower_Items(item.group, owner);
+        if (!item.repeat) {
+            out.insert(out.end(), one.begin(), one.end());
+            continue;
+        }
+        int h = Helper(owner);
+        Production more{one, -1, 0, false, {}};
+        if (item.repeat != '?')
+            more.symbols.push_back(Symbol{false, h});
+        if (item.repeat == 'l')
+            more.symbols.insert(more.symbols.begin(), Symbol{true, item.separator});
+        Nonterminals[h].productions.push_back(more);
+        Nonterminals[h].productions.push_back(Production{{}, -1, 0, false, {}});
+        if (item.repeat == '+' || item.repeat == 'l')
+            out.insert(out.end(), one.begin(), one.end());
+        out.push_back(Symbol{false, h});
+    }
+    return out;
+}
+
+// A new nonterminal for the rule 'owner' came from.
+int Helper(int owner) {
+    const string rule = Nonterminals[owner].rule;
+    int n = 0;
+    for (const Nonterminal& nt : Nonterminals)
+        n += nt.rule == rule;
+    Nonterminals.push_back(Nonterminal{rule + "_" + to_string(n), rule, {}});
+    Trees.push_back(Unknown);
+    return (int) Nonterminals.size() - 1;
+}
+
+// Counts the trees each nonterminal builds, where that is a fixed number:
+// one for a labeled production, the sum over its symbols for another.
+void Count_Trees() {
+    Trees.assign(Nonterminals.size(), Unknown);
+    for (bool changed = true; changed; ) {
+        changed = false;
+        for (size_t a = 0; a < Nonterminals.size(); ++a) {
+            int n = Unknown;
+            for (const Production& p : Nonterminals[a].productions)
+                n = Join(n, p.label >= 0 ? 1 : Count_Symbols(p.symbols));
+            changed |= n != Trees[a];
+            Trees[a] = n;
+        }
+    }
+}
+
+int Count_Symbols(const vector<Symbol>& symbols) {
+    int n = 0;
+    for (const Symbol& s : symbols) {
+        int k = s.terminal ? Is_Class(s.id) : Trees[s.id];
+        if (k == Varies || n == Varies)
+            n = Varies;
+        else if (k == Unknown || n == Unknown)
+            n = Unknown;
+        else
+            n += k;
+    }
+    return n;
+}
+
+// Whether a terminal is a class of tokens like '<identifier>', which
+// builds a leaf, rather than a spelling like '<='.
+bool Is_Class(int t) {
+    const string& s = Terminals[t];
+    return s.size() > 2 && s.front() == '<' && s.back() == '>';
+}
+
+int Join(int a, int b) {
+    if (a == Unknown || a == b)
+        return b;
+    return b == Unknown ? a : Varies;
+}
+
+// A -> A x | y becomes A -> y T, T -> x T | (empty): the tail T builds
+// each x over the tree A had built so far.
+void Remove_Left_Recursion(int a) {
+    vector<Production> base, recursive;
+    for (const Production& p : Nonterminals[a].productions) {
+        if (!p.symbols.empty() && p.symbols[0] == Symbol{false, a})
+            recursive.push_back(p);
+        else
+            base.push_back(p);
+    }
+    if (recursive.empty())
+        return;
+    int tail = Helper(a);
+    for (Production& p : base)
+        p.after.push_back(Symbol{false, tail});
+    for (Production& p : recursive) {
+        p.symbols.erase(p.symbols.begin());
+        if (p.label >= 0 && Trees[a] < 0)
+            Grammar_Error(Rules[a].line, "Left-recursive rule '" + Rules[a].name +
+                          "' must build a fixed number of trees.");
+        p.extra = p.label >= 0 ? Trees[a] : 0;
+        p.here = false;
+        p.after.push_back(Symbol{false, tail});
+    }
+    recursive.push_back(Production{{}, -1, 0, false, {}});
+    Nonterminals[a].productions = base;
+    Nonterminals[tail].productions = recursive;
+}
+
+// A -> x y | x z becomes A -> x R, R -> y | z for the longest prefix x
+// of the first productions that share a first symbol. Returns false if
+// none do.
+bool Factor_Prefix(int a) {
+    vector<Production> prods = Nonterminals[a].productions;
+    for (size_t i = 0; i < prods.size(); ++i) {
+        if (prods[i].symbols.empty())
+            continue;
+        vector<size_t> group;
+        for (size_t j = i; j < prods.size(); ++j)
+            if (!prods[j].symbols.empty() && prods[j].symbols[0] == prods[i].symbols[0])
+                group.push_back(j);
+        if (group.size() < 2)
+            continue;
+        size_t k = 1;
+        for (bool same = true; same; k += same) {
+            for (size_t j : group)
+                same &= k < prods[j].symbols.size() && prods[j].symbols[k] == prods[i].symbols[k];
+        }
+        vector<Symbol> prefix(prods[i].symbols.begin(), prods[i].symbols.begin() + k);
+        int count = Count_Symbols(prefix);
+        int rest = Helper(a);
+        for (size_t j : group) {
+            Production q = prods[j];
+            q.symbols.erase(q.symbols.begin(), q.symbols.begin() + k);
+            if (q.label >= 0) {
+                if (count < 0)
+                    Grammar_Error(Rules[a].line, "A prefix shared in rule '" + Nonterminals[a].rule +
+                                  "' must build a fixed number of trees.");
+                q.extra += count;
+                q.here = false;
+            }
+            Nonterminals[rest].productions.push_back(q);
+        }
+        prefix.push_back(Symbol{false, rest});
+        prods[i] = Production{prefix, -1, 0, false, {}};
+        for (size_t g = group.size() - 1; g > 0; --g)
+            prods.erase(prods.begin() + group[g]);
+        Nonterminals[a].productions = prods;
+        return true;
+    }
+    return false;
+}
+
+
+
+/**************************** TABLE ****************************/
+
+vector<Symbol> Sequence(const Production& p) {
+    vector<Symbol> s = p.symbols;
+    s.insert(s.end(), p.after.begin(), p.after.end());
+    return s;
+}
+
+// FIRST of symbols[from ..], and whether all of them can be empty.
+set<int> First_Of(const vector<Symbol>& symbols, size_t from, bool& nullable) {
+    set<int> first;
+    nullable = true;
+    for (size_t i = from; i < symbols.size() && nullable; ++i) {
+        if (symbols[i].terminal) {
+            first.insert(symbols[i].id);
+            nullable = false;
+        } else {
+            first.insert(First[symbols[i].id].begin(), First[symbols[i].id].end());
+            nullable = Nullable[symbols[i].id];
+        }
+    }
+    return first;
+}
+
+void Compute_First_Follow() {
+    size_t n = Nonterminals.size();
+    Nullable.assign(n, false);
+    First.assign(n, set<int>());
+    Follow.assign(n, set<int>());
+    for (bool changed = true; changed; ) {
+        changed = false;
+        for (size_t a = 0; a < n; ++a)
+            for (const Production& p : Nonterminals[a].productions) {
+                bool nullable;
+                set<int> first = First_Of(Sequence(p), 0, nullable);
+                size_t before = First[a].size();
+                First[a].insert(first.begin(), first.end());
+                changed |= First[a].size() != before || (nullable && !Nullable[a]);
+                Nullable[a] = Nullable[a] || nullable;
+            }
+    }
+    Follow[0].insert(Eof);
+    for (bool changed = true; changed; ) {
+        changed = false;
+        for (size_t a = 0; a < n; ++a)
+            for (const Production& p : Nonterminals[a].productions) {
+                vector<Symbol> s = Sequence(p);
+                for (size_t i = 0; i < s.size(); ++i) {
+                    if (s[i].terminal)
+                        continue;
+                    bool nullable;
+                    set<int> follow = First_Of(s, i + 1, nullable);
+                    if (nullable)
+                        follow.insert(Follow[a].begin(), Follow[a].end());
+                    size_t before = Follow[s[i].id].size();
+                    Follow[s[i].id].insert(follow.begin(), follow.end());
+                    changed |= Follow[s[i].id].size() != before;
+                }
+            }
+    }
+}
+
+void Build_Table() {
+    Table.assign(Nonterminals.size(), vector<int>(Terminals.size(), -1));
+    vector<bool> empty;
+    for (size_t a = 0; a < Nonterminals.size(); ++a)
+        for (size_t i = 0; i < Nonterminals[a].productions.size(); ++i) {
+            const Production& p = Nonterminals[a].productions[i];
+            int number = (int) Numbered.size();
+            Numbered.push_back(std::make_pair((int) a, (int) i));
+            bool nullable;
+            for (int t : First_Of(Sequence(p), 0, nullable)) {
+                int other = Table[a][t];
+                if (other >= 0)
+                    throw runtime_error(Grammar_Path + ": '" + Terminals[t] + "' starts both " +
+                                        Describe(a, Nonterminals[a].productions[Numbered[other].second]) +
+                                        " and " + Describe(a, p) + ".");
+                Table[a][t] = number;
+            }
+            empty.push_back(nullable);
+        }
+    for (size_t number = 0; number < Numbered.size(); ++number) {
+        if (!empty[number])
+            continue;
+        int a = Numbered[number].first;
+        const Production& p = Nonterminals[a].productions[Numbered[number].second];
+        for (int t : Follow[a]) {
+            int other = Table[a][t];
+            if (other < 0) {
+                Table[a][t] = (int) number;
+            } else if (other != (int) number) {
+                const Production& q = Nonterminals[a].productions[Numbered[other].second];
+                if (empty[other])
+                    throw runtime_error(Grammar_Path + ": both " + Describe(a, q) + " and " + Describe(a, p) +
+                                        " can be empty before '" + Terminals[t] + "'.");
+                Settled.push_back("on '" + Terminals[t] + "', " + Describe(a, q) + " rather than " + Describe(a, p));
+            }
+        }
+    }
+}
+
+// A production as the header's listing shows it.
+string Describe(int a, const Production& p) {
+    string s = Nonterminals[a].name + " ->";
+    if (p.label >= 0)
+        s += p.here ? " [@" : " [";
+    for (const Symbol& sym : p.symbols)
+        s += " " + (sym.terminal ? "'" + Terminals[sym.id] + "'" : Nonterminals[sym.id].name);
+    if (p.label >= 0)
+        s += " ] => \"" + Labels[p.label] + "\"" + (p.extra ? " +" + to_string(p.extra) : "");
+    for (const Symbol& sym : p.after)
+        s += " " + Nonterminals[sym.id].name;
+    if (p.label < 0 && p.symbols.empty() && p.after.empty())
+        s += " (empty)";
+    return s;
+}
+
+string C_String(const string& s) {
+    string out = "\"";
+    for (char c : s) {
+        if (c == '"' || c == '\\')
+            out += '\\';
+        out += c;
+    }
+    return out + "\"";
+}
+
+string Generate(const string& grammar_path) {
+    Read_Grammar(grammar_path);
+    Lower();
+    Count_Trees();
+    for (size_t a = 0; a < Rules.size(); ++a)
+        Remove_Left_Recursion((int) a);
+    for (size_t a = 0; a < Nonterminals.size(); ++a)
+        while (Factor_Prefix((int) a)) {}
+    Compute_First_Follow();
+    Build_Table();
+
+    std::ostringstream o;
+    o << "// Generated by ll1gen from " << grammar_path << "; do not edit. 'make' rebuilds it.\n"
+      << "//\n"
+      << "// The productions, numbered as in LL1_Predict. '[' is where a labeled\n"
+      << "// production's trees start ('[@' also takes the offset of the token there)\n"
+      << "// and '] => label +n' builds them and n trees from before into one node.\n";
+    for (size_t number = 0; number < Numbered.size(); ++number)
+        o << "// " << number << "\t" << Describe(Numbered[number].first,
+              Nonterminals[Numbered[number].first].productions[Numbered[number].second]) << "\n";
+    o << "//\n// Conflicts settled for the nonempty production:\n";
+    for (const string& s : Settled)
+        o << "// " << s << "\n";
+    o << "#ifndef SUBC_LL1_H\n#define SUBC_LL1_H\n\n"
+      << "constexpr int LL1_Num_Terminals = " << Terminals.size() << ";\n"
+      << "constexpr int LL1_Num_Nonterminals = " << Nonterminals.size() << ";\n"
+      << "constexpr int LL1_Eof = " << Eof << ";\n\n";
+
+    o << "constexpr const char* LL1_Terminals[] = {";
+    for (size_t t = 0; t < Terminals.size(); ++t)
+        o << (t % 8 ? " " : "\n    ") << C_String(Terminals[t]) << ",";
+    o << "\n};\n// The rule each nonterminal belongs to, for diagnostics.\n"
+      << "constexpr const char* LL1_Nonterminals[] = {";
+    for (size_t a = 0; a < Nonterminals.size(); ++a)
+        o << (a % 6 ? " " : "\n    ") << C_String(Nonterminals[a].rule) << ",";
+    o << "\n};\nconstexpr const char* LL1_Labels[] = {";
+    for (size_t l = 0; l < Labels.size(); ++l)
+        o << (l % 8 ? " " : "\n    ") << C_String(Labels[l]) << ",";
+    o << "\n};\n\n";
+
+    o << "// Production p is LL1_Rhs[LL1_Rhs_Start[p] .. LL1_Rhs_Start[p + 1]), last\n"
+      << "// symbol first, so that it is pushed onto the parse stack as it is.\n"
+      << "constexpr LL1_Symbol LL1_Rhs[] = {\n";
+    vector<int> starts;
+    int count = 0;
+    for (size_t number = 0; number < Numbered.size(); ++number) {
+        const Production& p = Nonterminals[Numbered[number].first].productions[Numbered[number].second];
+        vector<string> rhs;
+        if (p.label >= 0)
+            rhs.push_back("{LL1_MARK, 0, " + string(p.here ? "1" : "0") + "}");
+        for (const Symbol& s : p.symbols)
+            rhs.push_back(string(s.terminal ? "{LL1_TERMINAL, 0, " : "{LL1_NONTERMINAL, 0, ") + to_string(s.id) + "}");
+        if (p.label >= 0)
+            rhs.push_back("{LL1_BUILD, " + to_string(p.extra) + ", " + to_string(p.label) + "}");
+        for (const Symbol& s : p.after)
+            rhs.push_back("{LL1_NONTERMINAL, 0, " + to_string(s.id) + "}");
+        starts.push_back(count);
+        count += (int) rhs.size();
+        o << "    ";
+        for (size_t i = rhs.size(); i-- > 0; )
+            o << rhs[i] << ", ";
+        o << "// " << number << "\n";
+    }
+    starts.push_back(count);
+    o << "};\nconstexpr uint16_t LL1_Rhs_Start[] = {";
+    for (size_t i = 0; i < starts.size(); ++i)
+        o << (i % 16 ? " " : "\n    ") << starts[i] << ",";
+    o << "\n};\n\n";
+
+    o << "// The production to expand a nonterminal by, given the next terminal;\n"
+      << "// -1 if the terminal cannot come next.\n"
+      << "constexpr int16_t LL1_Predict[LL1_Num_Nonterminals][LL1_Num_Terminals] = {\n";
+    for (size_t a = 0; a < Nonterminals.size(); ++a) {
+        o << "    {";
+        for (size_t t = 0; t < Terminals.size(); ++t)
+            o << (t ? "," : "") << Table[a][t];
+        o << "},  // " << Nonterminals[a].name << "\n";
+    }
+    o << "};\n\n#endif\n";
+    return o.str();
+}
+
+
+
+/**************************** MAIN ****************************/
+
+int main(int argc, char* argv[]) {
+    if (argc != 3) {
+        std::cerr << "Usage: ll1gen path/to/grammar.txt path/to/subc_ll1.h\n";
+        return 2;
+    }
+    try {
+        string header = Generate(argv[1]);
+        std::ofstream out(argv[2]);
+        out << header;
+        if (!out)
+            throw runtime_error(string("Failed to write ") + argv[2] + ".");
+    } catch (const runtime_error& e) {
+        std::cerr << "ll1gen: " << e.what() << "\n";
+        return 1;
+    }
+    return 0;
+}
@@ -1,1095 +1,3444 @@
+#include "subc_internal.h"
 #include <iostream>         // console i/o
 #include <fstream>          // file i/o
-#include <memory>           // unique_ptr
-#include <utility>          // forward
-#include <stack>            // stack
-#include <unordered_set>    // unordered set
-#include <vector>           // vector
+#include <unordered_map>    // unordered map
+#include <algorithm>        // sort, reverse
+#include <cstdio>           // getchar, putchar
+#include <sstream>          // stringstream
+#include <thread>           // thread
+#include <chrono>           // steady_clock
+#include <mutex>            // mutex
+#include <csignal>          // signal
+#include <sys/socket.h>     // socket, bind, listen, accept, connect
+#include <sys/un.h>         // sockaddr_un
+#include <sys/stat.h>       // stat
+#include <sys/time.h>       // timeval
+#include <sys/resource.h>   // getrlimit
+#include <unistd.h>         // read, write, close, unlink
+#include <fcntl.h>          // open, posix_fadvise
+#include <sys/mman.h>       // mmap
+#include <sys/syscall.h>    // syscall
+#include <condition_variable>   // condition_variable
+#include <cstring>          // memset
+#include <cstdlib>          // strtoull
+#include <cerrno>           // errno
+#include <iomanip>          // setprecision
+#include <atomic>           // atomic
+#include <deque>            // deque
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h> // io_uring_params, io_uring_sqe, io_uring_cqe
+#define SUBC_IO_URING 1
+#endif
+#endif
+
 using std::cout;
 using std::endl;
-using std::string;
-using std::unique_ptr;
 using std::ifstream;
-using std::forward;
-using std::runtime_error;
-using std::isalpha;
 using std::isdigit;
 using std::isspace;
-using std::isalnum;
-using std::unordered_set;
 using std::move;
 using std::ostream;
+using std::runtime_error;
+using std::string;
+using std::unique_ptr;
+using std::unordered_map;
 using std::vector;
-
-
-/*******************  UTILITY FUNCTION FROM C++ 14 ******************/
-template<typename T, typename... Args>
-unique_ptr<T> make_unique(Args&&... args) {
-    return unique_ptr<T>(new T(forward<Args>(args)...));
-}
+using subc::detail::make_unique;
 
 
 
 /**************************** CONSTRUCTS ****************************/
-enum State {
-    START,
-    IDENTIFIER,
-    INTEGER,
-    OPEN_SINGLE_QUOTE,
-    OPEN_DOUBLE_QUOTE,
-    OPEN_CURLY_BRACKET,
-    OPEN_ANGLE_BRACKET,
-    CLOSE_ANGLE_BRACKET,
-    COLON,
-    COLON_EQUALS,
-    DOT,
-    OCTOTHORPE,
-    FINAL
+enum Symbol_Kind {
+    GLOBAL_VAR,
+    LOCAL_VAR,
+    CONSTANT
 };
-enum Token_Type {
-    KEYWORD,
-    ID,
-    INT,
-    CHAR,
-    STRING,
-    COMMENT,
-    DONT_CARE,
-    END_TOKEN
+struct Symbol {
+    Symbol_Kind kind;
+    int64_t value;          // slot for variables, value for constants
+    bool is_char;
 };
-struct Token {
-    Token_Type token_type;
-    string value;
-    bool operator!=(const Token& t) const {
-        return (token_type != t.token_type) || (value.compare(t.value) != 0);
-    }
-    bool operator==(const Token& t) const {
-        return (token_type == t.token_type) && (value.compare(t.value) == 0);
-    }
+struct Function_Info {
+    string name;
+    const TreeNode* node;
+    int num_params;
+    int num_slots;          // slot 0 is the result, then params, then locals
+    bool returns_char;
+    unordered_map<string, Symbol> scope;
+};
+struct Program_Info {
+    const TreeNode* root;
+    int num_globals;
+    unordered_map<string, Symbol> scope;
+    vector<Function_Info> functions;
+    unordered_map<string, int> function_index;
+};
+enum Flow {
+    NORMAL,
+    EXIT,
+    RETURN
+};
+// The control-flow graph of a function, or of the main block when f is
+// null. Everything lives in flat arrays: block b holds the instructions
+// instrs[instr_start[b] .. instr_start[b + 1]), and its successors and
+// predecessors are stored the same way. An instruction is a simple
+// statement, a for's init or step, or the condition or selector of an if,
+// while, repeat, for or case. Instruction i uses the variables
+// uses[use_start[i] .. use_start[i + 1]) and defines those in defs[...],
+// and a definition's index in 'defs' is its id in reaching definitions.
+// Block 0 is the entry and the last block the exit; neither has
+// instructions.
+struct Cfg {
+    Function_Info* f;
+    vector<int> instr_start;
+    vector<const TreeNode*> instrs;
+    vector<int> succ_start, succ;
+    vector<int> pred_start, pred;
+    vector<int> use_start, uses;
+    vector<int> def_start, defs;
+    vector<char> calls;             // per instruction: calls a function
+    vector<string> var_names;       // dense variable ids
+    vector<Symbol> var_symbols;
+    vector<int> rpo;                // blocks reachable from the entry, in reverse post-order
+    int num_blocks() const { return (int) instr_start.size() - 1; }
+};
+// One bit vector per block, stored row after row.
+struct Block_Sets {
+    int words;
+    vector<uint64_t> bits;
+    uint64_t* row(int b) { return &bits[(size_t) b * words]; }
+    const uint64_t* row(int b) const { return &bits[(size_t) b * words]; }
+    bool has(int b, int i) const { return (row(b)[i >> 6] >> (i & 63)) & 1; }
 };
-struct TreeNode {
-    int num_children;
-    Token token;
-    unique_ptr<TreeNode> left, right;
+// Type ids of 'p1 -types'. Each enumerated type takes the next id, the
+// program's first and then each function's own. TYPE_ERROR is given to
+// whatever was already reported, and matches any type, so one mistake is
+// not reported again by every expression around it.
+enum Type_Id {
+    TYPE_ERROR,
+    TYPE_INTEGER,
+    TYPE_CHAR,
+    TYPE_BOOLEAN,
+    FIRST_ENUM_TYPE
+};
+struct Typed_Name {
+    bool is_constant;
+    int type;
+};
+// The names of one scope. Type names are kept apart from the rest, since
+// a function may declare a variable named like a type (tiny_13's 'color').
+struct Type_Scope {
+    unordered_map<string, Typed_Name> names;
+    unordered_map<string, int> types;
+};
+struct Signature {
+    const TreeNode* node;
+    vector<int> params;
+    int result;
+};
+// What the functions are checked against: the program's scope, every
+// function's signature and the names of the program's enumerated types.
+// It is built before any function is checked and only read while they
+// are, so the threads checking them share it without locks.
+struct Check_Globals {
+    const TreeNode* root;
+    Type_Scope scope;
+    vector<string> type_names;      // of the ids from FIRST_ENUM_TYPE on
+    vector<Signature> functions;
+    unordered_map<string, int> function_index;
+};
+// One file of 'p1 -batch'. 'issued' is when its read was started and
+// 'finished' when the whole text was in, or the read failed.
+struct Batch_File {
+    string path;
+    string text;
+    int fd;
+    int error;              // errno of a failed open or read, else 0
+    size_t done;            // bytes read so far
+    bool ready;             // text is complete, or error is set
+    std::chrono::steady_clock::time_point issued, finished;
+};
+#ifdef SUBC_IO_URING
+// The mapped rings of an io_uring instance, used without liburing.
+struct Io_Ring {
+    int fd;
+    unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    io_uring_sqe* sqes;
+    io_uring_cqe* cqes;
+    void* sq_map;
+    void* cq_map;
+    size_t sq_map_len, cq_map_len, sqes_len;
+};
+#endif
+// Reads the files of a batch ahead of the parser: while file i is parsed,
+// files i + 1 .. i + depth are being read. Reads go through io_uring when
+// the kernel allows it, with one thread reaping their completions, and
+// otherwise through worker threads, with a posix_fadvise() hint per file
+// so that the kernel starts reading before a worker gets to it.
+struct Readahead {
+    vector<Batch_File> files;
+    size_t depth;
+    size_t issued;          // files [0, issued) have had their reads started
+    size_t taken;           // files [0, taken) were handed to the parser
+    bool ring;
+#ifdef SUBC_IO_URING
+    Io_Ring io;
+#endif
+    std::mutex lock;        // guards the fields below, 'ready' and the ring's submissions
+    std::condition_variable changed;
+    vector<std::thread> workers;    // reading threads, or the ring's reaper
+    size_t next_read;       // next file for a worker thread
+    bool stopping;
+    double waited_ms;       // time the parser spent blocked on reads
+};
+// One line of 'p1 -astdiff': '+' for a node only in the new tree, '-' for
+// one only in the old, '~' for a pair that differs. 'where' names the
+// function or program the node is in.
+struct Ast_Change {
+    char op;
+    string where;
+    const TreeNode* before;
+    const TreeNode* after;
 };
-ostream& operator << (ostream &o, const unique_ptr<TreeNode> &p) {
-    o << p -> token.value << "(" << p -> num_children << ")" << endl;
-    return o;
-}
-
-
-/**************************** SCANNER FD ****************************/
-Token Scan();
-void Handle_Start_State(State& S, Token& t);
-void Handle_Identifier_State(State& S, Token& t);
-void Handle_Open_Curly_Bracket_State(State& S, Token& t);
-void Handle_Colon_State(State& S, Token& t);
-void Handle_Colon_Equals_State(State& S, Token& t);
-void Handle_Open_Angle_Bracket_State(State& S, Token& t);
-void Handle_Close_Angle_Bracket_State(State& S, Token& t);
-void Handle_Integer_State(State& S, Token& t);
-void Handle_Dot_State(State& S, Token& t);
-void Handle_Octothorpe_State(State& S, Token& t);
-void Handle_Open_Single_Quote_State(State& S, Token& t);
-void Handle_Open_Double_Quote_State(State& S, Token& t);
-
-
-
-/**************************** PARSER FD ****************************/
-void Read(const Token& t);
-void Build_Tree(string& s, int n);
-void Tiny();
-void Name();
-void Consts();
-void Const();
-void ConstValue();
-void Types();
-void Type();
-void LitList();
-void Dclns();
-void Dcln();
-void SubProgs();
-void Fcn();
-void Params();
-void Body();
-void Statement();
-void Assignment();
-void Expression();
-void Term();
-void Factor();
-void Primary();
-void OutExp();
-void StringNode();
-void ForStat();
-void ForExp();
-void Caseclause();
-void CaseExpression();
-void OtherwiseClause();
+
+
+/**************************** SEMANTICS FD ****************************/
+const TreeNode* Child(const TreeNode* n, int i);
+const string& Ident_Name(const TreeNode* id);
+int64_t Literal_Value(const TreeNode* lit);
+Program_Info Analyze_Program(const TreeNode* root);
+void Collect_Declarations(Program_Info& P, unordered_map<string, Symbol>& scope, const TreeNode* consts,
+                          const TreeNode* types, const TreeNode* dclns, int& num_slots, Symbol_Kind kind);
+Symbol Lookup(Program_Info& P, Function_Info* f, const string& name);
+Function_Info& Lookup_Function(Program_Info& P, const string& name, int num_args);
+bool Is_Char_Expr(Program_Info& P, Function_Info* f, const TreeNode* e);
+bool Is_Binary(const TreeNode* e);
+int64_t Case_Label_Value(Program_Info& P, Function_Info* f, const TreeNode* label);
+
+
+
+/**************************** DATAFLOW FD ****************************/
+struct Cfg_Builder;
+Cfg Build_Cfg(Program_Info& P, Function_Info* f);
+void Lower_Statement(Cfg_Builder& B, const TreeNode* s);
+void Add_Instruction(Cfg_Builder& B, const TreeNode* s);
+void Add_Expression_Uses(Cfg_Builder& B, const TreeNode* e);
+int Variable_Id(Cfg_Builder& B, const string& name);
+int New_Block(Cfg_Builder& B);
+void Add_Edge(Cfg_Builder& B, int from, int to);
+void Index_Edges(Cfg& g, vector<std::pair<int, int>>& edges);
+Block_Sets Empty_Sets(int num_blocks, int num_bits);
+int Solve_Dataflow(const Cfg& g, bool forward, const Block_Sets& gen, const Block_Sets& kill,
+                   Block_Sets& in, Block_Sets& out);
+int Solve_Liveness(const Cfg& g, Block_Sets& live_in, Block_Sets& live_out);
+int Solve_Reaching(const Cfg& g, Block_Sets& reach_in, Block_Sets& reach_out);
+void Lint_Cfg(const Cfg& g, vector<std::pair<uint32_t, string>>& warnings);
+
+
+/**************************** TYPE CHECK FD ****************************/
+struct Type_Check;
+Check_Globals Collect_Globals(const TreeNode* root, vector<std::pair<uint32_t, string>>& found);
+void Declare_Names(Type_Scope& scope, const Type_Scope* outer, vector<string>& type_names, int first_type,
+                   const TreeNode* consts, const TreeNode* types, const TreeNode* dclns,
+                   vector<std::pair<uint32_t, string>>& found);
+void Declare_Name(Type_Scope& scope, const TreeNode* id, Typed_Name name, vector<std::pair<uint32_t, string>>& found);
+int Resolve_Type(const Type_Scope& scope, const Type_Scope* outer, const TreeNode* id,
+                 vector<std::pair<uint32_t, string>>& found);
+void Check_Function(const Check_Globals& G, size_t i, vector<std::pair<uint32_t, string>>& found);
+void Check_Statement(Type_Check& C, const TreeNode* s);
+int Check_Expression(Type_Check& C, const TreeNode* e);
+int Check_Binary(Type_Check& C, const TreeNode* e, int a);
+int Check_Call(Type_Check& C, const TreeNode* e);
+void Check_Case_Label(Type_Check& C, const TreeNode* label, int type, const TreeNode* user);
+int Check_Variable(Type_Check& C, const TreeNode* id);
+bool Expect_Type(Type_Check& C, const TreeNode* e, int expected, const TreeNode* user);
+bool Match_Type(Type_Check& C, const TreeNode* e, int type, int expected, const TreeNode* user);
+string Describe_Use(const TreeNode* e, const TreeNode* user);
+const Typed_Name* Find_Name(const Type_Scope& scope, const Type_Scope* outer, const string& name);
+Typed_Name Lookup_Typed(Type_Check& C, const TreeNode* id);
+void Report_Error(vector<std::pair<uint32_t, string>>& found, const TreeNode* n, const string& msg);
+string Type_Name(const Type_Check& C, int type);
+
+
+
+/**************************** AST DIFF FD ****************************/
+void Diff_Program(const TreeNode* a, const TreeNode* b, vector<Ast_Change>& changes);
+void Diff_Functions(const TreeNode* a, const TreeNode* b, vector<Ast_Change>& changes);
+void Diff_Children(const TreeNode* a, const TreeNode* b, const string& where, vector<Ast_Change>& changes);
+vector<std::pair<size_t, size_t>> Common_Subsequence(const vector<const TreeNode*>& x, size_t lo_x, size_t hi_x,
+                                                     const vector<const TreeNode*>& y, size_t lo_y, size_t hi_y);
+vector<const TreeNode*> Children(const TreeNode* n);
+bool Is_Statement(subc_kind kind);
+
+
+
+/**************************** READAHEAD FD ****************************/
+void Start_Readahead(Readahead& R, const vector<string>& paths, size_t depth, bool use_ring);
+Batch_File& Take_File(Readahead& R);
+void Stop_Readahead(Readahead& R);
+void Issue_Reads(Readahead& R, size_t until);
+void Open_Batch_File(Batch_File& f);
+void Read_Batch_File(Batch_File& f);
+void Read_Worker(Readahead* R);
+double Io_Busy_Ms(const vector<Batch_File>& files);
+#ifdef SUBC_IO_URING
+bool Ring_Setup(Io_Ring& ring, unsigned entries);
+void Ring_Read(Io_Ring& ring, Batch_File& f, uint64_t id);
+void Ring_Nop(Io_Ring& ring, uint64_t id);
+void Ring_Reaper(Readahead* R);
+void Ring_Close(Io_Ring& ring);
+#endif
+
+
+
+/**************************** INTERPRETER FD ****************************/
+struct Run_State;
+void Interpret(Program_Info& P);
+int64_t Call_Function(Run_State& R, Function_Info& f, vector<int64_t>& args);
+Flow Exec(Run_State& R, Function_Info* f, vector<int64_t>& frame, const TreeNode* s);
+int64_t Eval(Run_State& R, Function_Info* f, vector<int64_t>& frame, const TreeNode* e);
+int64_t Apply_Binary(const TreeNode* e, int64_t a, int64_t b);
+int64_t& Variable(Run_State& R, Function_Info* f, vector<int64_t>& frame, const string& name);
+void Runtime_Error(const string& msg);
+int Input_Skip_Space();
+bool Input_Eof();
+int64_t Input_Int();
+int64_t Input_Char();
+
+
+
+/**************************** CODEGEN FD ****************************/
+struct Gen_State;
+void Generate_Program(Program_Info& P, ostream& o);
+void Gen_Function(Gen_State& G, Function_Info& f);
+void Gen_Statement(Gen_State& G, Function_Info* f, const TreeNode* s);
+void Gen_Expression(Gen_State& G, Function_Info* f, const TreeNode* e);
+void Gen_Binary(Gen_State& G, const TreeNode* e);
+void Gen_Case(Gen_State& G, Function_Info* f, const TreeNode* s);
+void Gen_Runtime_Call(Gen_State& G, const string& fn);
+void Gen_Immediate(Gen_State& G, const string& op, int64_t v, const string& reg);
+string Gen_Variable(Gen_State& G, Function_Info* f, const string& name);
+string New_Label(Gen_State& G);
+
+
+
+/**************************** SERVER FD ****************************/
+void Serve(const string& socket_path);
+void Serve_Worker();
+void Serve_Connection(int fd);
+void Stop_Serving();
+int Client(const string& socket_path, const string& format, const string& path);
+string Render(const string& format, const char* buf, size_t len);
+bool Read_Frame(int fd, string& header, string& payload);
+bool Write_Frame(int fd, const string& header, const string& payload);
+bool Read_Full(int fd, char* buf, size_t n);
+bool Write_Full(int fd, const char* buf, size_t n);
+int Connect_Socket(const string& socket_path);
 
 
 
 /**************************** GLOBALS ****************************/
-ifstream inf;
-char c;
-Token Next_Token;
-std::stack<unique_ptr<TreeNode>> S;
-unordered_set<string> keywords =
-        {
-                "program", "var", "const", "type", "function",  "return", "begin",
-                "end", "output", "if",  "then", "else", "while", "do",
-                "case", "of", "otherwise", "repeat", "for", "until",  "loop",
-                "pool", "exit", "mod", "and", "or", "not", "read",
-                "succ", "pred", "chr", "ord", "eof"
-        };
-const Token T_program = Token{KEYWORD, "program"},
-        T_const = Token{KEYWORD, "const"},
-        T_type = Token{KEYWORD, "type"},
-        T_var = Token{KEYWORD, "var"},
-        T_function = Token{KEYWORD, "function"},
-        T_begin = Token{KEYWORD, "begin"},
-        T_end = Token{KEYWORD, "end"},
-        T_output = Token{KEYWORD, "output"},
-        T_or = Token{KEYWORD, "or"},
-        T_and = Token{KEYWORD, "and"},
-        T_mod = Token{KEYWORD, "mod"},
-        T_not = Token{KEYWORD, "not"},
-        T_eof = Token{KEYWORD, "eof"},
-        T_succ = Token{KEYWORD, "succ"},
-        T_pred = Token{KEYWORD, "pred"},
-        T_chr = Token{KEYWORD, "chr"},
-        T_ord = Token{KEYWORD, "ord"},
-        T_if = Token{KEYWORD, "if"},
-        T_else = Token{KEYWORD, "else"},
-        T_then = Token{KEYWORD, "then"},
-        T_while = Token{KEYWORD, "while"},
-        T_do = Token{KEYWORD, "do"},
-        T_until = Token{KEYWORD, "until"},
-        T_repeat = Token{KEYWORD, "repeat"},
-        T_for = Token{KEYWORD, "for"},
-        T_loop = Token{KEYWORD, "loop"},
-        T_pool = Token{KEYWORD, "pool"},
-        T_otherwise = Token{KEYWORD, "otherwise"},
-        T_of = Token{KEYWORD, "of"},
-        T_case = Token{KEYWORD, "case"},
-        T_read = Token{KEYWORD, "read"},
-        T_exit = Token{KEYWORD, "exit"},
-        T_return = Token{KEYWORD, "return"},
-        T_colon = Token{DONT_CARE, ":"},
-        T_equals = Token{DONT_CARE, "="},
-        T_comma = Token{DONT_CARE, ","},
-        T_semicolon = Token{DONT_CARE, ";"},
-        T_open_parenthesis = Token{DONT_CARE, "("},
-        T_close_parenthesis = Token{DONT_CARE, ")"},
-        T_colon_equals = Token{DONT_CARE, ":="},
-        T_colon_equals_colon = Token{DONT_CARE, ":=:"},
-        T_less_equals = Token{DONT_CARE, "<="},
-        T_less = Token{DONT_CARE, "<"},
-        T_greater = Token{DONT_CARE, ">"},
-        T_greater_equals = Token{DONT_CARE, ">="},
-        T_not_equals = Token{DONT_CARE, "<>"},
-        T_plus = Token{DONT_CARE, "+"},
-        T_minus = Token{DONT_CARE, "-"},
-        T_star = Token{DONT_CARE, "*"},
-        T_slash = Token{DONT_CARE, "/"},
-        T_dotdot = Token{DONT_CARE, ".."},
-        T_dot = Token{DONT_CARE, "."};
-
-
-
-/**************************** MAIN ****************************/
-
-void PreOrderTreeTraversal(const unique_ptr<TreeNode>& root, int N) {
-    if (root) {
-        for (int i = 0; i < N; i++) {
-            cout << ". ";
-        }
-        cout << root;
-        PreOrderTreeTraversal(root -> left, N+1);
-        PreOrderTreeTraversal(root -> right, N);
+string Source_Text;
+FILE* Stream_Spool = nullptr;
+bool Print_Locations = false;
+const int Table_Check_Runs = 3;     // per parser, for 'p1 -ll1'
+
+
+
+template <typename Node_Type>
+void Print_Node(Node_Type n, int depth, ostream& o) {
+    for (int i = 0; i < depth; i++) {
+        o << ". ";
+    }
+    o << n.label() << "(" << n.num_children() << ")";
+    if (Print_Locations)
+        o << " @" << Location(n.offset());
+    o << "\n";
+}
+
+void PreOrderTreeTraversal(subc::Node root, int N, ostream& o = cout) {
+    subc::preorder(root, [&](subc::Node n, int depth) { Print_Node(n, N + depth, o); });
+}
+
+// Function_Parsed hook for 'p1 -ast -': prints each function to the spool
+// and frees it.
+void Spool_Function(unique_ptr<TreeNode> fcn) {
+    std::ostringstream text;
+    PreOrderTreeTraversal(subc::Node(fcn.get()), 2, text);
+    fwrite(text.str().data(), 1, text.str().size(), Stream_Spool);
+}
+
+// Prints a program parsed with Spool_Function: its subprogs node has no
+// children, their text is in the spool instead.
+void Print_Streamed_Program(subc::Node root) {
+    Print_Node(root, 0, cout);
+    for (subc::Node p = root.first_child(); p; p = p.next_sibling()) {
+        Print_Node(p, 1, cout);
+        if (p.kind() == SUBC_SUBPROGS) {
+            char buffer[1 << 16];
+            size_t n;
+            cout.flush();
+            rewind(Stream_Spool);
+            while ((n = fread(buffer, 1, sizeof(buffer), Stream_Spool)) > 0)
+                fwrite(buffer, 1, n, stdout);
+            fflush(stdout);
+        } else {
+            PreOrderTreeTraversal(p.first_child(), 2);
+        }
     }
 }
 void command_line_args_error() {
   throw runtime_error("Invalid command-line args.\n"
-                       "The following 2 ways are acceptable:\n"
+                       "The following 18 ways are acceptable:\n"
                        "\t1) 'p1 path/to/testprog'\n"
-                       "\t2) 'p1 -ast path/to/testprog'");
+                       "\t2) 'p1 -ast [-loc|-share|-lazy|-ll1] path/to/testprog'\n"
+                       "\t3) 'p1 -run path/to/testprog'\n"
+                       "\t4) 'p1 -S path/to/testprog'\n"
+                       "\t5) 'p1 -tokens path/to/testprog'\n"
+                       "\t6) 'p1 -serve path/to/socket'\n"
+                       "\t7) 'p1 -client path/to/socket -ast|-tokens|-check path/to/testprog'\n"
+                       "\t8) 'p1 -client path/to/socket -shutdown'\n"
+                       "\t9) 'p1 -share path/to/testprog'\n"
+                       "\t10) 'p1 -find kind[:name] path/to/testprog'\n"
+                       "\t11) 'p1 -sigs path/to/testprog'\n"
+                       "\t12) 'p1 -lint path/to/testprog'\n"
+                       "\t13) 'p1 -cfg path/to/testprog'\n"
+                       "\t14) 'p1 -astdiff path/to/old path/to/new'\n"
+                       "\t15) 'p1 -batch[N] [-threads] path/to/testprog...'\n"
+                       "\t16) 'p1-prof -profile [trace.json] path/to/testprog'\n"
+                       "\t17) 'p1 -ll1 path/to/testprog'\n"
+                       "\t18) 'p1 -types path/to/testprog'\n"
+                       "A path of '-' reads the program from stdin; with -ast each\n"
+                       "function is printed and freed as soon as it is parsed.\n"
+                       "Any of them may add '-j' or '-jN' before the path to parse\n"
+                       "or tokenize on N threads (default: one per core); -types also\n"
+                       "checks functions on that many threads.");
 }
 void file_open_error() {
     throw runtime_error("Failed to open given filepath for testprogram.");
 }
+void Read_File(const string& path) {
+    std::stringstream buffer;
+    Source_Name = path == "-" ? "<stdin>" : path;
+    if (path == "-") {
+        buffer << std::cin.rdbuf();
+        Source_Text = buffer.str();
+        return;
+    }
+    ifstream inf(path, std::ios::binary);
+    if (!inf)
+        file_open_error();
+    buffer << inf.rdbuf();
+    Source_Text = buffer.str();
+}
+subc::Ast Parse_File(const string& path) {
+    if (path == "-") {
+        Source_Name = "<stdin>";
+        Set_Stream_Source();
+        return subc::Ast(Parse_Source());
+    }
+    Read_File(path);
+    return subc::parse(Source_Text.data(), Source_Text.size());
+}
+
+// Prints where each node of a kind is for 'p1 -find kind', or each node of
+// that kind named 'name' for 'p1 -find kind:name'. The index lists them
+// directly, so the cost is proportional to the matches.
+void Print_Matches(const string& query, const string& path) {
+    size_t colon = query.find(':');
+    string label = query.substr(0, colon);
+    int kind = 0;
+    while (kind < SUBC_TEXT && label != Kind_Names[kind])
+        kind++;
+    if (kind == SUBC_TEXT)
+        throw runtime_error("Unknown node kind '" + label + "'");
+    Read_File(path);
+    subc::Ast ast = subc::parse(Source_Text.data(), Source_Text.size(), SUBC_INDEX);
+    subc::Node_Range nodes = colon == string::npos ? ast.nodes((subc_kind) kind)
+                                                   : ast.nodes((subc_kind) kind, query.substr(colon + 1));
+    vector<uint32_t> offsets;
+    for (subc::Node n : nodes)
+        offsets.push_back(n.offset());
+    std::sort(offsets.begin(), offsets.end());
+    for (uint32_t offset : offsets)
+        cout << Location(offset) << "\n";
+}
+
+// Prints where each function is and its signature for 'p1 -sigs'. Only the
+// signatures are needed, so the bodies are skipped rather than parsed.
+void Print_Signatures(const string& path) {
+    Read_File(path);
+    subc::Ast ast = subc::parse(Source_Text.data(), Source_Text.size(), SUBC_LAZY_BODIES);
+    for (subc::Node p = ast.root().first_child(); p; p = p.next_sibling()) {
+        if (p.kind() != SUBC_SUBPROGS)
+            continue;
+        for (subc::Node fcn = p.first_child(); fcn; fcn = fcn.next_sibling()) {
+            cout << Location(fcn.offset()) << " " << fcn.child(0).first_child().label() << "(";
+            for (subc::Node var = fcn.child(1).first_child(); var; var = var.next_sibling()) {
+                for (subc::Node id = var.first_child(); id; id = id.next_sibling())
+                    cout << id.first_child().label() << (!id.next_sibling() ? "" : id.next_sibling().next_sibling() ? ", " : ": ");
+                if (var.next_sibling())
+                    cout << "; ";
+            }
+            cout << "): " << fcn.child(2).first_child().label() << "\n";
+        }
+    }
+}
+
+// Builds the CFG of each function and of the main block, in source order.
+vector<Cfg> Build_Cfgs(Program_Info& P) {
+    vector<Cfg> cfgs;
+    for (Function_Info& f : P.functions)
+        cfgs.push_back(Build_Cfg(P, &f));
+    cfgs.push_back(Build_Cfg(P, nullptr));
+    return cfgs;
+}
+
+// Prints the warnings of 'p1 -lint' in source order. Globals that no
+// function or main block mentions are reported too.
+void Print_Lint(const string& path) {
+    subc::Ast ast = Parse_File(path);
+    Program_Info P = Analyze_Program(ast.root().get());
+    vector<Cfg> cfgs = Build_Cfgs(P);
+    vector<std::pair<uint32_t, string>> warnings;
+    std::unordered_set<string> used;
+    for (const Cfg& g : cfgs) {
+        Lint_Cfg(g, warnings);
+        for (size_t v = 0; v < g.var_names.size(); ++v)
+            if (g.var_symbols[v].kind == GLOBAL_VAR)
+                used.insert(g.var_names[v]);
+    }
+    for (const TreeNode* dcln = Child(P.root, 3) -> left.get(); dcln; dcln = dcln -> right.get())
+        for (int i = 0; i < dcln -> num_children - 1; ++i)
+            if (!used.count(Ident_Name(Child(dcln, i))))
+                warnings.push_back(std::make_pair(Child(dcln, i) -> token.offset,
+                                                  "'" + Ident_Name(Child(dcln, i)) + "' is declared but never used"));
+    std::stable_sort(warnings.begin(), warnings.end(),
+                     [](const std::pair<uint32_t, string>& a, const std::pair<uint32_t, string>& b) {
+                         return a.first < b.first;
+                     });
+    for (const std::pair<uint32_t, string>& w : warnings)
+        cout << Diagnostic(w.first, "warning: " + w.second) << "\n";
+}
+
+// Prints the type errors of 'p1 -types' in source order, with warnings for
+// undeclared names, and returns 1 if there were errors. The declarations
+// and signatures are collected first; then the functions, and the main
+// block, are checked on Parse_Threads threads, each taking the next
+// unchecked function until none are left. They share the program's scope
+// read-only and each function has its own list, so the output does not
+// depend on which thread checked what.
+int Print_Type_Errors(const string& path) {
+    subc::Ast ast = Parse_File(path);
+    vector<std::pair<uint32_t, string>> diagnostics;
+    Check_Globals G = Collect_Globals(ast.root().get(), diagnostics);
+    vector<vector<std::pair<uint32_t, string>>> found(G.functions.size() + 1);
+    std::atomic<size_t> next(0);
+    auto check = [&]() {
+        for (size_t i = next++; i < found.size(); i = next++)
+            Check_Function(G, i, found[i]);
+    };
+    vector<std::thread> workers;
+    for (unsigned t = 1; t < Parse_Threads && t < found.size(); ++t)
+        workers.emplace_back(check);
+    check();
+    for (std::thread& worker : workers)
+        worker.join();
+
+    for (const vector<std::pair<uint32_t, string>>& f : found)
+        diagnostics.insert(diagnostics.end(), f.begin(), f.end());
+    std::stable_sort(diagnostics.begin(), diagnostics.end(),
+                     [](const std::pair<uint32_t, string>& a, const std::pair<uint32_t, string>& b) {
+                         return a.first < b.first;
+                     });
+    int errors = 0;
+    for (const std::pair<uint32_t, string>& d : diagnostics) {
+        cout << Diagnostic(d.first, d.second) << "\n";
+        errors += d.second.compare(0, 6, "error:") == 0;
+    }
+    return errors ? 1 : 0;
+}
+
+// Prints the size of each CFG and how many passes its analyses took for
+// 'p1 -cfg', then the time spent building and solving them all.
+void Print_Cfg_Stats(const string& path) {
+    subc::Ast ast = Parse_File(path);
+    Program_Info P = Analyze_Program(ast.root().get());
+    auto start = std::chrono::steady_clock::now();
+    vector<Cfg> cfgs = Build_Cfgs(P);
+    auto built = std::chrono::steady_clock::now();
+    vector<std::pair<int, int>> passes;
+    size_t blocks = 0, bits = 0;
+    for (const Cfg& g : cfgs) {
+        Block_Sets in, out;
+        int live = Solve_Liveness(g, in, out);
+        int reach = Solve_Reaching(g, in, out);
+        passes.push_back(std::make_pair(live, reach));
+        blocks += g.num_blocks();
+        bits += (size_t) g.num_blocks() * (g.var_names.size() + g.var_names.size() + g.defs.size());
+    }
+    auto solved = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < cfgs.size(); ++i) {
+        const Cfg& g = cfgs[i];
+        cout << (g.f ? g.f -> name : Ident_Name(Child(P.root, 0))) << ": " << g.num_blocks() << " blocks, "
+             << g.succ.size() << " edges, " << g.instrs.size() << " instructions, "
+             << g.var_names.size() << " variables, " << g.defs.size() << " definitions; liveness "
+             << passes[i].first << " passes, reaching definitions " << passes[i].second << " passes\n";
+    }
+    typedef std::chrono::duration<double, std::milli> ms;
+    cout << blocks << " blocks, " << bits / 64 << " words of bit vectors: built in "
+         << ms(built - start).count() << " ms, solved in " << ms(solved - built).count() << " ms\n";
+}
+
+// Compares the parsed tree with its hash-consed DAG for 'p1 -share'.
+void Print_Sharing(const string& path) {
+    Read_File(path);
+    subc::Ast ast = subc::parse(Source_Text.data(), Source_Text.size());
+    size_t tree_nodes = 0, tree_bytes = 0;
+    subc::preorder(ast.root(), [&](subc::Node n, int) {
+        size_t capacity = n.label().capacity();
+        tree_nodes++;
+        tree_bytes += sizeof(TreeNode) + (capacity > 15 ? capacity + 1 : 0);
+    });
+    subc::Dag dag = subc::parse_shared(Source_Text.data(), Source_Text.size());
+    cout << "tree   nodes " << tree_nodes << " bytes " << tree_bytes << "\n"
+         << "shared nodes " << dag.num_nodes() << " bytes " << dag.bytes() << "\n"
+         << "saved  " << (int) (100.0 - 100.0 * dag.bytes() / tree_bytes) << "% of node memory\n";
+}
+
+// Parses a file with both the hand-written parser and the table-driven one
+// generated from docs/grammar.txt, for 'p1 -ll1': prints how long each
+// took and whether they built the same tree, with the same offsets, or
+// both rejected the program. Returns 1 if they disagree. Each parser runs
+// Table_Check_Runs times, taking turns, and its best time counts: the first
+// parse also pays for growing the heap. Trees are kept as a list of their
+// nodes' kind, offset, hash and number of children and freed at once.
+int Check_Table_Parser(const string& path) {
+    struct Entry {
+        subc_kind kind;
+        int num_children;
+        uint32_t offset;
+        uint64_t hash;
+    };
+    Read_File(path);
+    vector<Entry> nodes[2];
+    string errors[2];
+    double ms[2] = {1e300, 1e300};
+    for (int run = 0; run < 2 * Table_Check_Runs; ++run) {
+        int i = run % 2;
+        subc::Ast ast;
+        auto start = std::chrono::steady_clock::now();
+        try {
+            if (i == 0) {
+                ast = subc::parse(Source_Text.data(), Source_Text.size());
+            } else {
+                Set_Source(Source_Text.data(), 0, Source_Text.size());
+                ast = subc::Ast(Parse_Table_Source());
+            }
+        } catch (const runtime_error& e) {
+            errors[i] = e.what();
+        }
+        ms[i] = std::min(ms[i], std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+        if (errors[i].empty() && run >= 2 * Table_Check_Runs - 2)
+            subc::preorder(ast.root(), [&](subc::Node n, int) {
+                nodes[i].push_back(Entry{n.kind(), n.num_children(), n.offset(), n.hash()});
+            });
+    }
+    cout << "hand-written " << ms[0] << " ms\n"
+         << "table-driven " << ms[1] << " ms (" << ms[1] / ms[0] << "x)\n";
+    if (!errors[0].empty() || !errors[1].empty()) {
+        cout << "hand-written: " << (errors[0].empty() ? "accepted" : errors[0]) << "\n"
+             << "table-driven: " << (errors[1].empty() ? "accepted" : errors[1]) << "\n";
+        return errors[0].empty() != errors[1].empty();
+    }
+    const vector<Entry>& a = nodes[0];
+    const vector<Entry>& b = nodes[1];
+    for (size_t i = 0; i < a.size() && i < b.size(); ++i)
+        if (a[i].kind != b[i].kind || a[i].num_children != b[i].num_children ||
+            a[i].offset != b[i].offset || a[i].hash != b[i].hash) {
+            cout << "trees differ at node " << i << ": " << Kind_Names[a[i].kind] << " at " << Location(a[i].offset)
+                 << " against " << Kind_Names[b[i].kind] << " at " << Location(b[i].offset) << "\n";
+            return 1;
+        }
+    if (a.size() != b.size()) {
+        cout << "trees differ: " << a.size() << " nodes against " << b.size() << "\n";
+        return 1;
+    }
+    cout << "trees are equal (" << a.size() << " nodes)\n";
+    return 0;
+}
+
+// Parses a file with the counters of a profiling build on, for 'p1
+// -profile': prints the productions by exclusive time, then how many trees
+// Build_Tree() made of each label, and if 'trace' is not empty, writes a
+// Chrome trace-event file there with one event per production activation.
+void Print_Profile(const string& path, const string& trace) {
+#ifndef SUBC_PROFILE
+    (void) path;
+    (void) trace;
+    throw runtime_error("This p1 was built without SUBC_PROFILE; 'make profile' builds p1-prof, which has -profile.");
+#else
+    Read_File(path);
+    Start_Profile(!trace.empty());
+    uint64_t start = Profile_Now();
+    subc::parse(Source_Text.data(), Source_Text.size());
+    uint64_t total_ns = Profile_Now() - start;
+
+    vector<string> names = Profile_Rule_Names();
+    vector<const Thread_Profile*> threads = Profile_Threads();
+    vector<Rule_Stats> rules(names.size());
+    uint64_t builds[SUBC_NUM_KINDS] = {};
+    uint64_t tokens = 0, events = 0, dropped = 0;
+    for (const Thread_Profile* P : threads) {
+        for (size_t r = 0; r < P -> rules.size(); ++r) {
+            rules[r].calls += P -> rules[r].calls;
+            rules[r].tokens += P -> rules[r].tokens;
+            rules[r].inclusive_ns += P -> rules[r].inclusive_ns;
+            rules[r].exclusive_ns += P -> rules[r].exclusive_ns;
+        }
+        for (int k = 0; k < SUBC_NUM_KINDS; ++k)
+            builds[k] += P -> builds[k];
+        tokens += P -> tokens;
+        events += P -> events.size();
+        dropped += P -> dropped_events;
+    }
+    vector<size_t> order;
+    for (size_t r = 0; r < rules.size(); ++r)
+        if (rules[r].calls)
+            order.push_back(r);
+    std::sort(order.begin(), order.end(), [&](size_t a, size_t b) { return rules[a].exclusive_ns > rules[b].exclusive_ns; });
+
+    char line[160];
+    snprintf(line, sizeof(line), "%-16s %10s %10s %11s %11s %7s\n", "rule", "calls", "tokens", "incl ms", "excl ms", "excl %");
+    cout << line;
+    for (size_t r : order) {
+        const Rule_Stats& R = rules[r];
+        snprintf(line, sizeof(line), "%-16s %10llu %10llu %11.3f %11.3f %7.1f\n", names[r].c_str(),
+                 (unsigned long long) R.calls, (unsigned long long) R.tokens, R.inclusive_ns / 1e6,
+                 R.exclusive_ns / 1e6, total_ns ? 100.0 * R.exclusive_ns / total_ns : 0.0);
+        cout << line;
+    }
+    cout << "parsed " << tokens << " tokens in " << total_ns / 1e6 << " ms on " << threads.size() << " thread(s)\n\n";
+    snprintf(line, sizeof(line), "%-16s %10s\n", "Build_Tree", "calls");
+    cout << line;
+    vector<int> kinds;
+    for (int k = 0; k < SUBC_NUM_KINDS; ++k)
+        if (builds[k])
+            kinds.push_back(k);
+    std::sort(kinds.begin(), kinds.end(), [&](int a, int b) { return builds[a] > builds[b]; });
+    for (int k : kinds) {
+        snprintf(line, sizeof(line), "%-16s %10llu\n", Kind_Names[k], (unsigned long long) builds[k]);
+        cout << line;
+    }
+    if (trace.empty())
+        return;
+
+    std::ofstream out(trace);
+    if (!out)
+        throw runtime_error("Failed to open " + trace + " for the trace.");
+    out << "{\"traceEvents\":[" << std::fixed << std::setprecision(3);
+    bool first = true;
+    for (const Thread_Profile* P : threads)
+        for (const Trace_Event& e : P -> events) {
+            out << (first ? "\n" : ",\n") << "{\"name\":\"" << names[e.rule] << "\",\"ph\":\"X\",\"pid\":1,\"tid\":"
+                << P -> id << ",\"ts\":" << e.start_ns / 1e3 << ",\"dur\":" << e.duration_ns / 1e3 << "}";
+            first = false;
+        }
+    out << "\n]}\n";
+    cout << "\nwrote " << events << " trace events to " << trace;
+    if (dropped)
+        cout << " (" << dropped << " more were dropped past " << Max_Trace_Events << " per thread)";
+    cout << "\n";
+#endif
+}
+
+// Parses every file for 'p1 -batch', reading up to 'depth' files ahead of
+// the parser, and prints the error of each file that fails, then how far
+// reading overlapped with parsing. A path of '-' reads the list of paths
+// from stdin, one per line. Returns 1 if any file failed.
+int Parse_Batch(vector<string> paths, size_t depth, bool use_ring) {
+    if (paths.size() == 1 && paths[0] == "-") {
+        paths.clear();
+        string line;
+        while (std::getline(std::cin, line))
+            if (!line.empty())
+                paths.push_back(line);
+    }
+    Readahead R;
+    auto start = std::chrono::steady_clock::now();
+    Start_Readahead(R, paths, depth, use_ring);
+    size_t failed = 0, bytes = 0;
+    double parse_ms = 0;
+    for (size_t i = 0; i < paths.size(); ++i) {
+        Batch_File& f = Take_File(R);
+        if (f.error) {
+            cout << f.path << ": " << strerror(f.error) << "\n";
+            failed++;
+            continue;
+        }
+        auto parse_start = std::chrono::steady_clock::now();
+        Source_Name = f.path;
+        try {
+            subc::parse(f.text.data(), f.text.size());
+        } catch (const runtime_error& e) {
+            cout << e.what() << "\n";
+            failed++;
+        }
+        parse_ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - parse_start).count();
+        bytes += f.text.size();
+        string().swap(f.text);
+    }
+    Stop_Readahead(R);
+    typedef std::chrono::duration<double, std::milli> ms;
+    double total_ms = ms(std::chrono::steady_clock::now() - start).count();
+    double busy_ms = Io_Busy_Ms(R.files);
+    double overlap = busy_ms > 0 ? std::max(0.0, 100.0 * (busy_ms - R.waited_ms) / busy_ms) : 100.0;
+    cout << paths.size() << " files, " << bytes << " bytes, " << failed << " failed: " << total_ms
+         << " ms in all, " << parse_ms << " ms parsing; reads were in flight for " << busy_ms
+         << " ms and the parser waited " << R.waited_ms << " ms for them, so " << (int) overlap
+         << "% of I/O overlapped parsing (" << (R.ring ? "io_uring" : "threads") << ", "
+         << R.depth << " files ahead)\n";
+    return failed ? 1 : 0;
+}
+
+// Prints how the program at 'after' differs from the one at 'before' for
+// 'p1 -astdiff', one change per line, and returns 1 if there were any and
+// 0 if not, as diff(1) does. Locations are in the old source for '-', the
+// new one for '+', and both for '~'.
+int Print_Ast_Diff(const string& before, const string& after) {
+    Read_File(before);
+    string before_text = move(Source_Text);
+    subc::Ast old_ast = subc::parse(before_text.data(), before_text.size());
+    Read_File(after);
+    subc::Ast new_ast = subc::parse(Source_Text.data(), Source_Text.size());
+    vector<Ast_Change> changes;
+    Diff_Program(old_ast.root().get(), new_ast.root().get(), changes);
+
+    // Location() reads the current source, so each side is looked up in turn
+    vector<string> from(changes.size()), to(changes.size());
+    Set_Source(before_text.data(), 0, before_text.size());
+    for (size_t i = 0; i < changes.size(); ++i)
+        if (changes[i].before)
+            from[i] = Location(changes[i].before -> token.offset);
+    Set_Source(Source_Text.data(), 0, Source_Text.size());
+    for (size_t i = 0; i < changes.size(); ++i)
+        if (changes[i].after)
+            to[i] = Location(changes[i].after -> token.offset);
+    for (size_t i = 0; i < changes.size(); ++i) {
+        const Ast_Change& change = changes[i];
+        const TreeNode* n = change.after ? change.after : change.before;
+        cout << change.op << " ";
+        if (n -> kind == SUBC_FCN)
+            cout << "fcn " << change.where;
+        else
+            cout << change.where << ": " << n -> token.value;
+        cout << " " << (change.before ? from[i] : to[i]);
+        if (change.before && change.after)
+            cout << " -> " << to[i];
+        cout << "\n";
+    }
+    return changes.empty() ? 0 : 1;
+}
 
 int main(int argc, char* argv[]) {
     vector<string> v;
     for (int i = 1; i < argc; ++i)
         v.push_back(std::string(argv[i]));
-    if (v.size() == 2) {
-        if (v.at(0) == "-ast") {
-            inf.open(v.at(1));
-            if (inf) {
-                inf.get(c);
-                Next_Token = Scan();
-                Tiny();
-                PreOrderTreeTraversal(S.top(), 0);
-            } else {
-                file_open_error();
-            }
+    if (v.size() >= 2 && v.at(0).compare(0, 6, "-batch") == 0) {
+        string depth = v.at(0).substr(6);
+        bool threads = v.at(1) == "-threads";
+        vector<string> paths(v.begin() + (threads ? 2 : 1), v.end());
+        if (paths.empty())
+            command_line_args_error();
+        return Parse_Batch(paths, depth.empty() ? 16 : std::stoul(depth), !threads);
+    }
+    if (v.size() >= 2 && v.at(v.size() - 2).compare(0, 2, "-j") == 0) {
+        string threads = v.at(v.size() - 2).substr(2);
+        Parse_Threads = threads.empty() ? std::thread::hardware_concurrency() : std::stoul(threads);
+        v.erase(v.end() - 2);
+    }
+    bool share = false, lazy = false, table = false;
+    if (v.size() == 3 && v.at(0) == "-ast" && (v.at(1) == "-loc" || v.at(1) == "-share" || v.at(1) == "-lazy" ||
+                                               v.at(1) == "-ll1")) {
+        Print_Locations = v.at(1) == "-loc";
+        share = v.at(1) == "-share";
+        lazy = v.at(1) == "-lazy";
+        table = v.at(1) == "-ll1";
+        v.erase(v.begin() + 1);
+    }
+    if (v.size() == 3 && v.at(0) == "-find") {
+        Print_Matches(v.at(1), v.at(2));
+    } else if (v.size() == 3 && v.at(0) == "-profile") {
+        Print_Profile(v.at(2), v.at(1));
+    } else if (v.size() == 3 && v.at(0) == "-astdiff") {
+        return Print_Ast_Diff(v.at(1), v.at(2));
+    } else if (v.size() == 4 && v.at(0) == "-client") {
+        return Client(v.at(1), v.at(2), v.at(3));
+    } else if (v.size() == 3 && v.at(0) == "-client" && v.at(2) == "-shutdown") {
+        return Client(v.at(1), v.at(2), "");
+    } else if (v.size() == 2) {
+        if (v.at(0) == "-serve") {
+            Serve(v.at(1));
+        } else if (v.at(0) == "-ast" && v.at(1) == "-") {
+            Stream_Spool = std::tmpfile();
+            if (!Stream_Spool)
+                throw runtime_error("Failed to create a temporary file for streaming.");
+            Function_Parsed = Spool_Function;
+            Print_Streamed_Program(Parse_File(v.at(1)).root());
+        } else if (v.at(0) == "-ast" && share) {
+            Read_File(v.at(1));
+            subc::Dag dag = subc::parse_shared(Source_Text.data(), Source_Text.size());
+            subc::preorder(dag.root(), [](subc::Dag_Node n, int depth) { Print_Node(n, depth, cout); });
+        } else if (v.at(0) == "-ast" && lazy) {
+            Read_File(v.at(1));
+            subc::Ast ast = subc::parse(Source_Text.data(), Source_Text.size(), SUBC_LAZY_BODIES);
+            ast.expand_all();
+            PreOrderTreeTraversal(ast.root(), 0);
+        } else if (v.at(0) == "-ast" && table) {
+            Read_File(v.at(1));
+            Set_Source(Source_Text.data(), 0, Source_Text.size());
+            PreOrderTreeTraversal(subc::Ast(Parse_Table_Source()).root(), 0);
+        } else if (v.at(0) == "-ll1") {
+            return Check_Table_Parser(v.at(1));
+        } else if (v.at(0) == "-profile") {
+            Print_Profile(v.at(1), "");
+        } else if (v.at(0) == "-share") {
+            Print_Sharing(v.at(1));
+        } else if (v.at(0) == "-sigs") {
+            Print_Signatures(v.at(1));
+        } else if (v.at(0) == "-lint") {
+            Print_Lint(v.at(1));
+        } else if (v.at(0) == "-cfg") {
+            Print_Cfg_Stats(v.at(1));
+        } else if (v.at(0) == "-types") {
+            return Print_Type_Errors(v.at(1));
+        } else if (v.at(0) == "-ast") {
+            PreOrderTreeTraversal(Parse_File(v.at(1)).root(), 0);
+        } else if (v.at(0) == "-run") {
+            subc::Ast ast = Parse_File(v.at(1));
+            Program_Info P = Analyze_Program(ast.root().get());
+            Interpret(P);
+        } else if (v.at(0) == "-tokens") {
+            Read_File(v.at(1));
+            for (const Token& t : Scan_All(Source_Text.data(), Source_Text.size(), Parse_Threads))
+                cout << Token_Type_Names[t.token_type] << " " << t.value << "\n";
+        } else if (v.at(0) == "-S") {
+            subc::Ast ast = Parse_File(v.at(1));
+            Program_Info P = Analyze_Program(ast.root().get());
+            Generate_Program(P, cout);
         } else {
             command_line_args_error();
         }
     } else if (v.size() == 1) {
-        inf.open(v.at(0));
-        if (inf) {
-            inf.get(c);
-            Next_Token = Scan();
-            Tiny();
-        } else {
-            file_open_error();
-        }
+        Parse_File(v.at(0));
     } else {
         command_line_args_error();
     }
-    inf.close();
     return 0;
 }
 
 
 
-/**************************** SCANNER ****************************/
+/**************************** SEMANTICS ****************************/
 
-Token Scan() {
-    Token t = Token();
-    State S = START;
-    while (S != FINAL && inf.good()) {
-        switch (S) {
-            case START:
-                Handle_Start_State(S, t);
-                break;
-            case IDENTIFIER:
-                Handle_Identifier_State(S, t);
-                break;
-            case OPEN_CURLY_BRACKET:
-                Handle_Open_Curly_Bracket_State(S, t);
-                break;
-            case COLON:
-                Handle_Colon_State(S, t);
-                break;
-            case COLON_EQUALS:
-                Handle_Colon_Equals_State(S, t);
-                break;
-            case OPEN_ANGLE_BRACKET:
-                Handle_Open_Angle_Bracket_State(S, t);
-                break;
-            case CLOSE_ANGLE_BRACKET:
-                Handle_Close_Angle_Bracket_State(S, t);
-                break;
-            case INTEGER:
-                Handle_Integer_State(S, t);
-                break;
-            case DOT:
-                Handle_Dot_State(S, t);
-                break;
-            case OCTOTHORPE:
-                Handle_Octothorpe_State(S, t);
-                break;
-            case OPEN_SINGLE_QUOTE:
-                Handle_Open_Single_Quote_State(S, t);
-                break;
-            case OPEN_DOUBLE_QUOTE:
-                Handle_Open_Double_Quote_State(S, t);
-                break;
-            default:
-                throw runtime_error("Could not resolve state S");
-                break;
+const TreeNode* Child(const TreeNode* n, int i) {
+    const TreeNode* p = n -> left.get();
+    while (i-- > 0)
+        p = p -> right.get();
+    return p;
+}
+
+const string& Ident_Name(const TreeNode* id) {
+    return id -> left -> token.value;
+}
+
+int64_t Literal_Value(const TreeNode* lit) {
+    return lit -> token.number;
+}
+
+Program_Info Analyze_Program(const TreeNode* root) {
+    Program_Info P;
+    P.root = root;
+    P.num_globals = 0;
+    P.scope["true"] = Symbol{CONSTANT, 1, false};
+    P.scope["false"] = Symbol{CONSTANT, 0, false};
+    Collect_Declarations(P, P.scope, Child(root, 1), Child(root, 2), Child(root, 3), P.num_globals, GLOBAL_VAR);
+
+    for (const TreeNode* fcn = Child(root, 4) -> left.get(); fcn; fcn = fcn -> right.get()) {
+        Function_Info f;
+        f.name = Ident_Name(Child(fcn, 0));
+        f.node = fcn;
+        f.num_params = 0;
+        f.num_slots = 1;
+        f.returns_char = Ident_Name(Child(fcn, 2)) == "char";
+        f.scope[f.name] = Symbol{LOCAL_VAR, 0, f.returns_char};
+        for (const TreeNode* dcln = Child(fcn, 1) -> left.get(); dcln; dcln = dcln -> right.get()) {
+            bool is_char = Ident_Name(Child(dcln, dcln -> num_children - 1)) == "char";
+            for (int i = 0; i < dcln -> num_children - 1; ++i) {
+                f.scope[Ident_Name(Child(dcln, i))] = Symbol{LOCAL_VAR, f.num_slots++, is_char};
+                f.num_params++;
+            }
         }
+        Collect_Declarations(P, f.scope, Child(fcn, 3), Child(fcn, 4), Child(fcn, 5), f.num_slots, LOCAL_VAR);
+        if (P.function_index.count(f.name))
+            throw runtime_error("Function " + f.name + " is defined more than once");
+        P.function_index[f.name] = (int) P.functions.size();
+        P.functions.push_back(move(f));
     }
+    return P;
+}
 
-    // Ignore Comment
-    if (t.token_type == COMMENT)
-        return Scan();
-
-    // Edge case: Last char in file is space. So reading this causes t to be empty.
-    if (t.value.empty())
-        t.token_type = END_TOKEN;
-
-    return t;
-}
-
-void Handle_Start_State(State& S, Token& t) {
-    if (c == '_' || isalpha(c))
-        S = IDENTIFIER;
-    else if (c == '{')
-        S = OPEN_CURLY_BRACKET;
-    else if (c == ':')
-        S = COLON;
-    else if (c == ';' || c == '(' ||c == ')' ||c == '+' ||c == '-' || c == '*' ||
-             c == '/' || c == '=' || c == ',') {
-        S = FINAL;
-        t.token_type = DONT_CARE;
-    }
-    else if (c == '<')
-        S = OPEN_ANGLE_BRACKET;
-    else if (c == '>')
-        S = CLOSE_ANGLE_BRACKET;
-    else if (isdigit(c))
-        S = INTEGER;
-    else if (c == '.')
-        S = DOT;
-    else if (c == '#')
-        S = OCTOTHORPE;
-    else if (c == '\'')
-        S = OPEN_SINGLE_QUOTE;
-    else if (c == '\"')
-        S = OPEN_DOUBLE_QUOTE;
-    else if (isspace(c))
-        {}
-    else
-        throw runtime_error(string(1, c));
+void Collect_Declarations(Program_Info& P, unordered_map<string, Symbol>& scope, const TreeNode* consts,
+                          const TreeNode* types, const TreeNode* dclns, int& num_slots, Symbol_Kind kind) {
+    for (const TreeNode* k = consts -> left.get(); k; k = k -> right.get()) {
+        const TreeNode* value = Child(k, 1);
+        Symbol sym = Symbol{CONSTANT, 0, false};
+        if (value -> kind == SUBC_IDENTIFIER) {
+            const Symbol* other = nullptr;
+            auto it = scope.find(Ident_Name(value));
+            if (it != scope.end()) {
+                other = &it -> second;
+            } else {
+                auto global = P.scope.find(Ident_Name(value));
+                if (global != P.scope.end())
+                    other = &global -> second;
+            }
+            if (!other || other -> kind != CONSTANT)
+                throw runtime_error("Constant " + Ident_Name(Child(k, 0)) + " has a non-constant value");
+            sym = *other;
+        } else {
+            sym.value = Literal_Value(value);
+            sym.is_char = value -> kind == SUBC_CHAR;
+        }
+        scope[Ident_Name(Child(k, 0))] = sym;
+    }
+    for (const TreeNode* t = types -> left.get(); t; t = t -> right.get()) {
+        int64_t ordinal = 0;
+        for (const TreeNode* lit = Child(t, 1) -> left.get(); lit; lit = lit -> right.get())
+            scope[Ident_Name(lit)] = Symbol{CONSTANT, ordinal++, false};
+    }
+    for (const TreeNode* dcln = dclns -> left.get(); dcln; dcln = dcln -> right.get()) {
+        bool is_char = Ident_Name(Child(dcln, dcln -> num_children - 1)) == "char";
+        for (int i = 0; i < dcln -> num_children - 1; ++i)
+            scope[Ident_Name(Child(dcln, i))] = Symbol{kind, num_slots++, is_char};
+    }
+}
 
-    if (!isspace(c))
-        t.value += c;
-    inf.get(c);
+Symbol Lookup(Program_Info& P, Function_Info* f, const string& name) {
+    if (f) {
+        auto it = f -> scope.find(name);
+        if (it != f -> scope.end())
+            return it -> second;
+    }
+    auto it = P.scope.find(name);
+    if (it != P.scope.end())
+        return it -> second;
+
+    // The test programs assign to undeclared names (e.g. 'd:=Hanoi(...)'), so
+    // those become integer globals on first use.
+    Symbol sym = Symbol{GLOBAL_VAR, P.num_globals++, false};
+    P.scope[name] = sym;
+    return sym;
 }
 
-void Handle_Identifier_State(State& S, Token& t) {
-    if (c == '_' || isalnum(c)) {
-        S = IDENTIFIER;
-        t.value += c;
-        inf.get(c);
-    } else {
-        if (keywords.find(t.value) != keywords.end())
-            t.token_type = KEYWORD;
-        else
-            t.token_type = ID;
-        S = FINAL;
+Function_Info& Lookup_Function(Program_Info& P, const string& name, int num_args) {
+    auto it = P.function_index.find(name);
+    if (it == P.function_index.end())
+        throw runtime_error("Call to undefined function " + name);
+    Function_Info& f = P.functions.at(it -> second);
+    if (f.num_params != num_args)
+        throw runtime_error("Wrong number of arguments in call to " + name);
+    return f;
+}
+
+bool Is_Char_Expr(Program_Info& P, Function_Info* f, const TreeNode* e) {
+    switch (e -> kind) {
+        case SUBC_CHAR:
+        case SUBC_CHR:
+            return true;
+        case SUBC_SUCC:
+        case SUBC_PRED:
+            return Is_Char_Expr(P, f, Child(e, 0));
+        case SUBC_IDENTIFIER:
+            return Lookup(P, f, Ident_Name(e)).is_char;
+        case SUBC_CALL:
+            return Lookup_Function(P, Ident_Name(Child(e, 0)), e -> num_children - 1).returns_char;
+        default:
+            return false;
     }
 }
 
-void Handle_Open_Curly_Bracket_State(State& S, Token& t) {
-    if (c != '}')
-        S = OPEN_CURLY_BRACKET;
-    else {
-        t.token_type = COMMENT;
-        S = FINAL;
+// A chain like 1 + 1 + ... is a left-deep tree of these, as deep as the
+// chain is long, so the passes over expressions walk down its left operands
+// in a loop and apply the operators on the way back up, rather than
+// recursing into both operands.
+bool Is_Binary(const TreeNode* e) {
+    return e -> kind >= SUBC_LE && e -> kind <= SUBC_MOD && e -> num_children == 2;
+}
+
+int64_t Case_Label_Value(Program_Info& P, Function_Info* f, const TreeNode* label) {
+    if (label -> kind != SUBC_IDENTIFIER)
+        return Literal_Value(label);
+    Symbol sym = Lookup(P, f, Ident_Name(label));
+    if (sym.kind != CONSTANT)
+        throw runtime_error("Case label " + Ident_Name(label) + " is not a constant");
+    return sym.value;
+}
+
+
+
+/**************************** DATAFLOW ****************************/
+
+// Lowers statements into the Cfg it builds. Blocks are numbered in the
+// order they start and only the newest block takes instructions, so each
+// block's instructions are contiguous in g.instrs.
+struct Cfg_Builder {
+    Program_Info& P;
+    Cfg& g;
+    vector<std::pair<int, int>> edges;
+    vector<vector<int>> loop_exits;     // blocks ending in 'exit', per enclosing loop
+    vector<int> returns;                // blocks ending in 'return'
+    unordered_map<string, int> var_ids; // -1 for constants
+    int current;
+};
+
+// Builds the CFG of 'f', or of the main block if f is null.
+Cfg Build_Cfg(Program_Info& P, Function_Info* f) {
+    Cfg g;
+    g.f = f;
+    g.use_start.push_back(0);
+    g.def_start.push_back(0);
+    Cfg_Builder B = Cfg_Builder{P, g, {}, {{}}, {}, {}, 0};
+    int entry = New_Block(B);
+    Add_Edge(B, entry, New_Block(B));
+    Lower_Statement(B, f ? Child(f -> node, 6) : Child(P.root, 5));
+    int last = B.current;
+    int exit = New_Block(B);
+    Add_Edge(B, last, exit);
+    for (int r : B.returns)
+        Add_Edge(B, r, exit);
+    for (int e : B.loop_exits.back())       // 'exit' outside any loop leaves the function
+        Add_Edge(B, e, exit);
+    g.instr_start.push_back((int) g.instrs.size());
+    Index_Edges(g, B.edges);
+
+    // Depth-first from the entry with an explicit stack, since functions
+    // may have thousands of blocks
+    int n = g.num_blocks();
+    vector<char> seen(n, 0);
+    vector<std::pair<int, int>> stack;      // block, next successor to try
+    vector<int> post;
+    seen[entry] = 1;
+    stack.push_back(std::make_pair(entry, g.succ_start[entry]));
+    while (!stack.empty()) {
+        int b = stack.back().first;
+        int k = stack.back().second;
+        if (k < g.succ_start[b + 1]) {
+            stack.back().second++;
+            int s = g.succ[k];
+            if (!seen[s]) {
+                seen[s] = 1;
+                stack.push_back(std::make_pair(s, g.succ_start[s]));
+            }
+        } else {
+            post.push_back(b);
+            stack.pop_back();
+        }
     }
-    t.value += c;
-    inf.get(c);
+    g.rpo.assign(post.rbegin(), post.rend());
+    return g;
 }
 
-void Handle_Colon_State(State& S, Token& t) {
-    if (c == '=') {
-        S = COLON_EQUALS;
-        t.value += c;
-        inf.get(c);
-    } else {
-        t.token_type = DONT_CARE;
-        S = FINAL;          // Must take empty to final state
+void Lower_Statement(Cfg_Builder& B, const TreeNode* s) {
+    switch (s -> kind) {
+        case SUBC_BLOCK:
+            for (const TreeNode* p = s -> left.get(); p; p = p -> right.get())
+                Lower_Statement(B, p);
+            break;
+        case SUBC_IF: {
+            Add_Instruction(B, Child(s, 0));
+            int test = B.current;
+            Add_Edge(B, test, New_Block(B));
+            Lower_Statement(B, Child(s, 1));
+            int then_end = B.current;
+            int else_end = test;
+            if (s -> num_children == 3) {
+                Add_Edge(B, test, New_Block(B));
+                Lower_Statement(B, Child(s, 2));
+                else_end = B.current;
+            }
+            int join = New_Block(B);
+            Add_Edge(B, then_end, join);
+            Add_Edge(B, else_end, join);
+            break;
+        }
+        case SUBC_WHILE: {
+            int before = B.current;
+            int head = New_Block(B);
+            Add_Edge(B, before, head);
+            Add_Instruction(B, Child(s, 0));
+            Add_Edge(B, head, New_Block(B));
+            Lower_Statement(B, Child(s, 1));
+            Add_Edge(B, B.current, head);
+            Add_Edge(B, head, New_Block(B));
+            break;
+        }
+        case SUBC_REPEAT: {
+            const TreeNode* cond = Child(s, s -> num_children - 1);
+            int before = B.current;
+            int top = New_Block(B);
+            Add_Edge(B, before, top);
+            for (const TreeNode* p = s -> left.get(); p != cond; p = p -> right.get())
+                Lower_Statement(B, p);
+            Add_Instruction(B, cond);
+            int test = B.current;
+            Add_Edge(B, test, top);
+            Add_Edge(B, test, New_Block(B));
+            break;
+        }
+        case SUBC_FOR: {
+            Add_Instruction(B, Child(s, 0));
+            int before = B.current;
+            int head = New_Block(B);
+            Add_Edge(B, before, head);
+            Add_Instruction(B, Child(s, 1));
+            Add_Edge(B, head, New_Block(B));
+            Lower_Statement(B, Child(s, 3));
+            Add_Instruction(B, Child(s, 2));
+            Add_Edge(B, B.current, head);
+            Add_Edge(B, head, New_Block(B));
+            break;
+        }
+        case SUBC_LOOP: {
+            int before = B.current;
+            int top = New_Block(B);
+            Add_Edge(B, before, top);
+            B.loop_exits.push_back(vector<int>());
+            for (const TreeNode* p = s -> left.get(); p; p = p -> right.get())
+                Lower_Statement(B, p);
+            Add_Edge(B, B.current, top);
+            int after = New_Block(B);
+            for (int e : B.loop_exits.back())
+                Add_Edge(B, e, after);
+            B.loop_exits.pop_back();
+            break;
+        }
+        case SUBC_CASE: {
+            Add_Instruction(B, Child(s, 0));
+            int test = B.current;
+            vector<int> ends;
+            bool otherwise = false;
+            for (const TreeNode* p = Child(s, 1); p; p = p -> right.get()) {
+                Add_Edge(B, test, New_Block(B));
+                Lower_Statement(B, Child(p, p -> num_children - 1));
+                ends.push_back(B.current);
+                otherwise = otherwise || p -> kind == SUBC_OTHERWISE;
+            }
+            if (!otherwise)
+                ends.push_back(test);
+            int join = New_Block(B);
+            for (int e : ends)
+                Add_Edge(B, e, join);
+            break;
+        }
+        case SUBC_EXIT:
+            B.loop_exits.back().push_back(B.current);
+            New_Block(B);                   // what follows is unreachable
+            break;
+        case SUBC_RETURN:
+            Add_Instruction(B, s);
+            B.returns.push_back(B.current);
+            New_Block(B);
+            break;
+        case SUBC_NULL:
+            break;
+        default:
+            Add_Instruction(B, s);
+            break;
     }
 }
 
-void Handle_Colon_Equals_State(State& S, Token& t) {
-    if (c == ':') {
-        S = FINAL;
-        t.value += c;
-        inf.get(c);
-    } else {
-        t.token_type = DONT_CARE;
-        S = FINAL;          // Must take empty to final state
+// Appends 's' to the current block with the variables it uses and defines.
+void Add_Instruction(Cfg_Builder& B, const TreeNode* s) {
+    Cfg& g = B.g;
+    g.instrs.push_back(s);
+    g.calls.push_back(0);
+    int v;
+    switch (s -> kind) {
+        case SUBC_ASSIGN:
+            Add_Expression_Uses(B, Child(s, 1));
+            if ((v = Variable_Id(B, Ident_Name(Child(s, 0)))) >= 0)
+                g.defs.push_back(v);
+            break;
+        case SUBC_SWAP:
+            for (int i = 0; i < 2; ++i) {
+                if ((v = Variable_Id(B, Ident_Name(Child(s, i)))) >= 0) {
+                    g.uses.push_back(v);
+                    g.defs.push_back(v);
+                }
+            }
+            break;
+        case SUBC_READ:
+            for (const TreeNode* p = s -> left.get(); p; p = p -> right.get())
+                if ((v = Variable_Id(B, Ident_Name(p))) >= 0)
+                    g.defs.push_back(v);
+            break;
+        case SUBC_OUTPUT:
+            for (const TreeNode* p = s -> left.get(); p; p = p -> right.get())
+                if (p -> kind == SUBC_OUT_INTEGER)
+                    Add_Expression_Uses(B, Child(p, 0));
+            break;
+        case SUBC_RETURN:
+            Add_Expression_Uses(B, Child(s, 0));
+            if (g.f && (v = Variable_Id(B, g.f -> name)) >= 0)
+                g.defs.push_back(v);
+            break;
+        default:                            // a condition or case selector
+            Add_Expression_Uses(B, s);
+            break;
     }
+    g.use_start.push_back((int) g.uses.size());
+    g.def_start.push_back((int) g.defs.size());
 }
 
-void Handle_Open_Angle_Bracket_State(State& S, Token& t){
-    if (c == '>' || c == '=') {
-        t.token_type = DONT_CARE;
-        S = FINAL;
-        t.value += c;
-        inf.get(c);
-    } else {
-        t.token_type = DONT_CARE;
-        S = FINAL;          // Must take empty to final state
+// Adds the variables e reads in preorder, walking with a stack of the
+// siblings still to visit so that a long operator chain does not recurse.
+void Add_Expression_Uses(Cfg_Builder& B, const TreeNode* e) {
+    vector<const TreeNode*> pending(1, e);
+    while (!pending.empty()) {
+        e = pending.back();
+        pending.pop_back();
+        if (e -> kind == SUBC_IDENTIFIER) {
+            int v = Variable_Id(B, Ident_Name(e));
+            if (v >= 0)
+                B.g.uses.push_back(v);
+            continue;
+        }
+        const TreeNode* p = e -> left.get();
+        if (e -> kind == SUBC_CALL) {
+            B.g.calls.back() = 1;
+            p = p -> right.get();
+        }
+        size_t first = pending.size();
+        for (; p; p = p -> right.get())
+            pending.push_back(p);
+        std::reverse(pending.begin() + first, pending.end());
     }
 }
 
-void Handle_Close_Angle_Bracket_State(State& S, Token& t){
-    if (c == '=') {
-        t.token_type = DONT_CARE;
-        S = FINAL;
-        t.value += c;
-        inf.get(c);
-    } else {
-        t.token_type = DONT_CARE;
-        S = FINAL;          // Must take empty to final state
+// The dense id of a variable, or -1 for a constant. Names are resolved the
+// way the interpreter resolves them, so a local shadows a global.
+int Variable_Id(Cfg_Builder& B, const string& name) {
+    auto it = B.var_ids.find(name);
+    if (it != B.var_ids.end())
+        return it -> second;
+    Symbol sym = Lookup(B.P, B.g.f, name);
+    int id = -1;
+    if (sym.kind != CONSTANT) {
+        id = (int) B.g.var_names.size();
+        B.g.var_names.push_back(name);
+        B.g.var_symbols.push_back(sym);
     }
+    B.var_ids[name] = id;
+    return id;
 }
 
-void Handle_Integer_State(State& S, Token& t) {
-    if (isdigit(c)) {
-        S = INTEGER;
-        t.value += c;
-        inf.get(c);
-    } else {
-        t.token_type= INT;
-        S = FINAL;          // Must take empty to final state
+int New_Block(Cfg_Builder& B) {
+    B.g.instr_start.push_back((int) B.g.instrs.size());
+    return B.current = (int) B.g.instr_start.size() - 1;
+}
+
+void Add_Edge(Cfg_Builder& B, int from, int to) {
+    B.edges.push_back(std::make_pair(from, to));
+}
+
+// Sorts the edges into g's successor and predecessor arrays.
+void Index_Edges(Cfg& g, vector<std::pair<int, int>>& edges) {
+    int n = g.num_blocks();
+    g.succ_start.assign(n + 1, 0);
+    g.pred_start.assign(n + 1, 0);
+    for (const std::pair<int, int>& e : edges) {
+        g.succ_start[e.first + 1]++;
+        g.pred_start[e.second + 1]++;
+    }
+    for (int b = 0; b < n; ++b) {
+        g.succ_start[b + 1] += g.succ_start[b];
+        g.pred_start[b + 1] += g.pred_start[b];
+    }
+    vector<int> next_succ(g.succ_start.begin(), g.succ_start.end() - 1);
+    vector<int> next_pred(g.pred_start.begin(), g.pred_start.end() - 1);
+    g.succ.resize(edges.size());
+    g.pred.resize(edges.size());
+    for (const std::pair<int, int>& e : edges) {
+        g.succ[next_succ[e.first]++] = e.second;
+        g.pred[next_pred[e.second]++] = e.first;
     }
 }
 
-void Handle_Dot_State(State& S, Token& t) {
-    if (c == '.') {
-        t.token_type = DONT_CARE;
-        S = FINAL;
-        t.value += c;
-        inf.get(c);
-    } else {
-        t.token_type = DONT_CARE;
-        S = FINAL;          // Must take empty to final state
+// Rows are padded to a multiple of four words, so the loops over them can
+// work on four words at a time.
+Block_Sets Empty_Sets(int num_blocks, int num_bits) {
+    int words = (num_bits + 255) / 256 * 4;
+    return Block_Sets{words, vector<uint64_t>((size_t) num_blocks * words, 0)};
+}
+
+// Solves out = gen | (in & ~kill), where 'in' is the union of the 'out' of
+// the predecessors (forward) or successors (backward), starting from empty
+// sets. Blocks are visited in reverse post-order (forward) or post-order
+// (backward), and a block is only revisited once a neighbour it reads has
+// changed. The meet and transfer run over whole rows four words at a time,
+// which the compiler turns into vector instructions even at -O2. Returns
+// the number of passes.
+int Solve_Dataflow(const Cfg& g, bool forward, const Block_Sets& gen, const Block_Sets& kill,
+                   Block_Sets& in, Block_Sets& out) {
+    int n = g.num_blocks();
+    int words = gen.words;
+    in = Empty_Sets(n, words * 64);
+    out = Empty_Sets(n, words * 64);
+    vector<int> order(g.rpo);
+    if (!forward)
+        std::reverse(order.begin(), order.end());
+    const vector<int>& from_start = forward ? g.pred_start : g.succ_start;
+    const vector<int>& from = forward ? g.pred : g.succ;
+    const vector<int>& to_start = forward ? g.succ_start : g.pred_start;
+    const vector<int>& to = forward ? g.succ : g.pred;
+    vector<char> dirty(n, 0);
+    for (int b : order)
+        dirty[b] = 1;
+
+    int passes = 0;
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        passes++;
+        for (int b : order) {
+            if (!dirty[b])
+                continue;
+            dirty[b] = 0;
+            uint64_t* x = in.row(b);
+            for (int k = from_start[b]; k < from_start[b + 1]; ++k) {
+                const uint64_t* y = out.row(from[k]);
+                for (int w = 0; w < words; w += 4) {
+                    uint64_t m0 = x[w] | y[w], m1 = x[w + 1] | y[w + 1];
+                    uint64_t m2 = x[w + 2] | y[w + 2], m3 = x[w + 3] | y[w + 3];
+                    x[w] = m0;
+                    x[w + 1] = m1;
+                    x[w + 2] = m2;
+                    x[w + 3] = m3;
+                }
+            }
+            const uint64_t* gn = gen.row(b);
+            const uint64_t* kl = kill.row(b);
+            uint64_t* o = out.row(b);
+            uint64_t diff = 0;
+            for (int w = 0; w < words; w += 4) {
+                uint64_t v0 = gn[w] | (x[w] & ~kl[w]);
+                uint64_t v1 = gn[w + 1] | (x[w + 1] & ~kl[w + 1]);
+                uint64_t v2 = gn[w + 2] | (x[w + 2] & ~kl[w + 2]);
+                uint64_t v3 = gn[w + 3] | (x[w + 3] & ~kl[w + 3]);
+                diff |= (v0 ^ o[w]) | (v1 ^ o[w + 1]) | (v2 ^ o[w + 2]) | (v3 ^ o[w + 3]);
+                o[w] = v0;
+                o[w + 1] = v1;
+                o[w + 2] = v2;
+                o[w + 3] = v3;
+            }
+            if (diff) {
+                changed = true;
+                for (int k = to_start[b]; k < to_start[b + 1]; ++k)
+                    dirty[to[k]] = 1;
+            }
+        }
     }
+    return passes;
 }
 
-void Handle_Octothorpe_State(State& S, Token& t) {
-    if (c != '\n') {
-        S = OCTOTHORPE;
-        t.value += c;
-        inf.get(c);
-    } else {
-        t.token_type = COMMENT;
-        S = FINAL;          // Must take empty to final state
+// Variables live on entry to and exit from each block. A call may read any
+// global, and globals and the function's result are live when it returns.
+int Solve_Liveness(const Cfg& g, Block_Sets& live_in, Block_Sets& live_out) {
+    int n = g.num_blocks();
+    int num_vars = (int) g.var_names.size();
+    Block_Sets use = Empty_Sets(n, num_vars);
+    Block_Sets def = Empty_Sets(n, num_vars);
+    vector<uint64_t> globals(use.words, 0);
+    for (int v = 0; v < num_vars; ++v)
+        if (g.var_symbols[v].kind == GLOBAL_VAR)
+            globals[v >> 6] |= 1ull << (v & 63);
+
+    for (int b = 0; b < n; ++b) {
+        uint64_t* u = use.row(b);
+        uint64_t* d = def.row(b);
+        for (int i = g.instr_start[b + 1] - 1; i >= g.instr_start[b]; --i) {
+            for (int k = g.def_start[i]; k < g.def_start[i + 1]; ++k) {
+                u[g.defs[k] >> 6] &= ~(1ull << (g.defs[k] & 63));
+                d[g.defs[k] >> 6] |= 1ull << (g.defs[k] & 63);
+            }
+            for (int k = g.use_start[i]; k < g.use_start[i + 1]; ++k)
+                u[g.uses[k] >> 6] |= 1ull << (g.uses[k] & 63);
+            if (g.calls[i])
+                for (int w = 0; w < use.words; ++w)
+                    u[w] |= globals[w];
+        }
     }
+    if (g.f) {
+        uint64_t* u = use.row(n - 1);
+        for (int v = 0; v < num_vars; ++v)
+            if (g.var_symbols[v].kind == GLOBAL_VAR || g.var_symbols[v].value == 0)
+                u[v >> 6] |= 1ull << (v & 63);
+    }
+    return Solve_Dataflow(g, false, use, def, live_out, live_in);
 }
 
-void Handle_Open_Single_Quote_State(State& S, Token& t) {
-    if (c != '\'') {
-        S = OPEN_SINGLE_QUOTE;
-    } else {
-        t.token_type = CHAR;
-        S = FINAL;
+// Definitions reaching the entry to and exit from each block. Definition
+// k is g.defs[k]; definition g.defs.size() + v stands for the value v has
+// on entry, so a use it reaches may read v before any assignment. Calls
+// are not treated as defining the globals they may assign.
+int Solve_Reaching(const Cfg& g, Block_Sets& reach_in, Block_Sets& reach_out) {
+    int n = g.num_blocks();
+    int num_vars = (int) g.var_names.size();
+    int num_defs = (int) g.defs.size() + num_vars;
+    Block_Sets of_var = Empty_Sets(num_vars, num_defs);
+    for (int k = 0; k < (int) g.defs.size(); ++k)
+        of_var.row(g.defs[k])[k >> 6] |= 1ull << (k & 63);
+    for (int v = 0; v < num_vars; ++v) {
+        int k = (int) g.defs.size() + v;
+        of_var.row(v)[k >> 6] |= 1ull << (k & 63);
     }
-    t.value += c;
-    inf.get(c);
+
+    Block_Sets gen = Empty_Sets(n, num_defs);
+    Block_Sets kill = Empty_Sets(n, num_defs);
+    vector<int> last_def(num_vars, -1);
+    vector<int> defined;
+    for (int b = 0; b < n; ++b) {
+        for (int k = g.def_start[g.instr_start[b]]; k < g.def_start[g.instr_start[b + 1]]; ++k) {
+            if (last_def[g.defs[k]] < 0)
+                defined.push_back(g.defs[k]);
+            last_def[g.defs[k]] = k;
+        }
+        uint64_t* gn = gen.row(b);
+        uint64_t* kl = kill.row(b);
+        for (int v : defined) {
+            const uint64_t* mask = of_var.row(v);
+            for (int w = 0; w < kill.words; ++w)
+                kl[w] |= mask[w];
+            gn[last_def[v] >> 6] |= 1ull << (last_def[v] & 63);
+            last_def[v] = -1;
+        }
+        defined.clear();
+    }
+    for (int v = 0; v < num_vars; ++v) {
+        int k = (int) g.defs.size() + v;
+        gen.row(0)[k >> 6] |= 1ull << (k & 63);
+    }
+    return Solve_Dataflow(g, true, gen, kill, reach_in, reach_out);
 }
 
-void Handle_Open_Double_Quote_State(State& S, Token& t) {
-    if (c != '\"') {
-        S = OPEN_DOUBLE_QUOTE;
-    } else {
-        t.token_type = STRING;
-        S = FINAL;
-    }
-    t.value += c;
-    inf.get(c);
-}
-
-
-/**************************** PARSER ****************************/
-
-void Read(const Token& t) {
-    if (t != Next_Token)
-        throw runtime_error("Token did not match expected value.");
-
-    if (t.token_type != KEYWORD && t.token_type != DONT_CARE) {
-        unique_ptr<TreeNode> N;
-
-        if (t.token_type == ID) {
-            N = make_unique<TreeNode>(TreeNode{1, Token{DONT_CARE, "<identifier>"}, nullptr, nullptr});
-            N -> left = make_unique<TreeNode>(TreeNode{0, Token{DONT_CARE, t.value}, nullptr, nullptr});
-            S.push(move(N));
-            N.release();
-        } else if (t.token_type == INT) {
-            N = make_unique<TreeNode>(TreeNode{1, Token{DONT_CARE, "<integer>"}, nullptr, nullptr});
-            N -> left = make_unique<TreeNode>(TreeNode{0, Token{DONT_CARE, t.value}, nullptr, nullptr});
-            S.push(move(N));
-            N.release();
-        } else if (t.token_type == CHAR) {
-            N = make_unique<TreeNode>(TreeNode{1, Token{DONT_CARE, "<char>"}, nullptr, nullptr});
-            N -> left = make_unique<TreeNode>(TreeNode{0, Token{DONT_CARE, t.value}, nullptr, nullptr});
-            S.push(move(N));
-            N.release();
-        } else if (t.token_type == STRING) {
-            N = make_unique<TreeNode>(TreeNode{1, Token{DONT_CARE, "<string>"}, nullptr, nullptr});
-            N -> left = make_unique<TreeNode>(TreeNode{0, Token{DONT_CARE, t.value}, nullptr, nullptr});
-            S.push(move(N));
-            N.release();
-        } else {
-            throw runtime_error("Unresolved Token_Type in Read()");
-        }
-    }
-    Next_Token = Scan();
-}
-
-void Build_Tree(string& s, int n){
-    unique_ptr<TreeNode> p;
-    unique_ptr<TreeNode> c;
-    for (int i = 1; i <= n; ++i) {
-        c = move(S.top());
-        S.pop();
-        c -> right = move(p);
-        p = move(c);
-    }
-    unique_ptr<TreeNode> N = make_unique<TreeNode>(TreeNode{n, Token{KEYWORD, s}, nullptr, nullptr});
-    N -> left = move(p);
-    S.push(move(N));
-    p.release();
-    c.release();
-    N.release();
-}
-
-void Tiny() {
-    Read(T_program);
-    Name();
-    Read(T_colon);
-    Consts();
-    Types();
-    Dclns();
-    SubProgs();
-    Body();
-    Name();
-    Read(T_dot);
-    string s = "program";
-    Build_Tree(s, 7);
-}
-
-void Name() {
-    if (Next_Token.token_type == ID)
-        Read(Next_Token);
-    else
-        throw runtime_error("Name() Expected an identifier");
-}
-
-void Consts() {
-    int N = 1;
-    string s = "consts";
-    if (Next_Token == T_const) {
-        Read(T_const);
-        Const();
-        while (Next_Token == T_comma) {
-            Read(T_const);
-            Const();
-            N++;
-        }
-        Read (T_semicolon);
-        Build_Tree(s, N);
-    } else {
-        Build_Tree(s, 0);
+// Appends (offset, message) for unreachable code, assignments whose value
+// is never used, locals that may be read before they are assigned, and
+// locals that are never used.
+void Lint_Cfg(const Cfg& g, vector<std::pair<uint32_t, string>>& warnings) {
+    int n = g.num_blocks();
+    int num_vars = (int) g.var_names.size();
+    Block_Sets live_in, live_out, reach_in, reach_out;
+    Solve_Liveness(g, live_in, live_out);
+    Solve_Reaching(g, reach_in, reach_out);
+    vector<char> reachable(n, 0);
+    for (int b : g.rpo)
+        reachable[b] = 1;
+
+    // Only the first instruction of each unreachable region is reported
+    vector<char> covered(n, 0);
+    for (int b = 0; b < n; ++b) {
+        if (reachable[b])
+            continue;
+        for (int k = g.pred_start[b]; k < g.pred_start[b + 1]; ++k)
+            covered[b] = covered[b] || covered[g.pred[k]];
+        if (!covered[b] && g.instr_start[b] < g.instr_start[b + 1]) {
+            warnings.push_back(std::make_pair(g.instrs[g.instr_start[b]] -> token.offset, string("unreachable code")));
+            covered[b] = 1;
+        }
+    }
+    if (!g.f)
+        return;
+
+    int words = live_in.words;
+    vector<uint64_t> globals(words, 0);
+    for (int v = 0; v < num_vars; ++v)
+        if (g.var_symbols[v].kind == GLOBAL_VAR)
+            globals[v >> 6] |= 1ull << (v & 63);
+    vector<uint32_t> first_unassigned(num_vars, UINT32_MAX);
+    for (int b : g.rpo) {
+        // Backwards from the block's live-out set, for dead assignments
+        vector<uint64_t> live(live_out.row(b), live_out.row(b) + words);
+        for (int i = g.instr_start[b + 1] - 1; i >= g.instr_start[b]; --i) {
+            const TreeNode* s = g.instrs[i];
+            for (int k = g.def_start[i]; k < g.def_start[i + 1]; ++k) {
+                int v = g.defs[k];
+                if (s -> kind == SUBC_ASSIGN && g.var_symbols[v].kind == LOCAL_VAR && !((live[v >> 6] >> (v & 63)) & 1))
+                    warnings.push_back(std::make_pair(s -> token.offset, "value assigned to '" + g.var_names[v] + "' is never used"));
+                live[v >> 6] &= ~(1ull << (v & 63));
+            }
+            for (int k = g.use_start[i]; k < g.use_start[i + 1]; ++k)
+                live[g.uses[k] >> 6] |= 1ull << (g.uses[k] & 63);
+            if (g.calls[i])
+                for (int w = 0; w < words; ++w)
+                    live[w] |= globals[w];
+        }
+
+        // Forwards, tracking which variables still have their entry value
+        vector<char> unassigned(num_vars);
+        for (int v = 0; v < num_vars; ++v)
+            unassigned[v] = reach_in.has(b, (int) g.defs.size() + v);
+        for (int i = g.instr_start[b]; i < g.instr_start[b + 1]; ++i) {
+            for (int k = g.use_start[i]; k < g.use_start[i + 1]; ++k) {
+                int v = g.uses[k];
+                const Symbol& sym = g.var_symbols[v];
+                if (unassigned[v] && sym.kind == LOCAL_VAR && (sym.value == 0 || sym.value > g.f -> num_params))
+                    first_unassigned[v] = std::min(first_unassigned[v], g.instrs[i] -> token.offset);
+            }
+            for (int k = g.def_start[i]; k < g.def_start[i + 1]; ++k)
+                unassigned[g.defs[k]] = 0;
+        }
+    }
+    for (int v = 0; v < num_vars; ++v)
+        if (first_unassigned[v] != UINT32_MAX)
+            warnings.push_back(std::make_pair(first_unassigned[v], "'" + g.var_names[v] + "' may be used before it is assigned"));
+
+    std::unordered_set<string> used(g.var_names.begin(), g.var_names.end());
+    for (const TreeNode* dcln = Child(g.f -> node, 5) -> left.get(); dcln; dcln = dcln -> right.get())
+        for (int i = 0; i < dcln -> num_children - 1; ++i)
+            if (!used.count(Ident_Name(Child(dcln, i))))
+                warnings.push_back(std::make_pair(Child(dcln, i) -> token.offset,
+                                                  "'" + Ident_Name(Child(dcln, i)) + "' is declared but never used"));
+}
+
+
+
+/**************************** TYPE CHECK ****************************/
+
+// The check of one function, or of the main block when f is null. Its own
+// enumerated types take the ids after the program's.
+struct Type_Check {
+    const Check_Globals& G;
+    const Signature* f;
+    Type_Scope local;
+    vector<string> type_names;
+    std::unordered_set<string> undeclared;
+    vector<std::pair<uint32_t, string>>& found;
+    vector<const TreeNode*> spine;  // operators of the chains being checked; see Is_Binary()
+};
+
+Check_Globals Collect_Globals(const TreeNode* root, vector<std::pair<uint32_t, string>>& found) {
+    Check_Globals G;
+    G.root = root;
+    G.scope.types["integer"] = TYPE_INTEGER;
+    G.scope.types["char"] = TYPE_CHAR;
+    G.scope.types["boolean"] = TYPE_BOOLEAN;
+    G.scope.names["true"] = Typed_Name{true, TYPE_BOOLEAN};
+    G.scope.names["false"] = Typed_Name{true, TYPE_BOOLEAN};
+    Declare_Names(G.scope, nullptr, G.type_names, FIRST_ENUM_TYPE, Child(root, 1), Child(root, 2), Child(root, 3), found);
+
+    // Parameters and results can only name the program's types
+    for (const TreeNode* fcn = Child(root, 4) -> left.get(); fcn; fcn = fcn -> right.get()) {
+        Signature s;
+        s.node = fcn;
+        for (const TreeNode* dcln = Child(fcn, 1) -> left.get(); dcln; dcln = dcln -> right.get()) {
+            int type = Resolve_Type(G.scope, nullptr, Child(dcln, dcln -> num_children - 1), found);
+            for (int i = 0; i < dcln -> num_children - 1; ++i)
+                s.params.push_back(type);
+        }
+        s.result = Resolve_Type(G.scope, nullptr, Child(fcn, 2), found);
+        const string& name = Ident_Name(Child(fcn, 0));
+        if (G.function_index.count(name))
+            Report_Error(found, fcn, "function '" + name + "' is defined more than once");
+        else
+            G.function_index[name] = (int) G.functions.size();
+        G.functions.push_back(move(s));
+    }
+    return G;
+}
+
+// Declares the constants, enumerated types and variables of a scope. Type
+// i of type_names has the id first_type + i, and its literals are
+// constants of that type; 'outer' is the program's scope for a function.
+void Declare_Names(Type_Scope& scope, const Type_Scope* outer, vector<string>& type_names, int first_type,
+                   const TreeNode* consts, const TreeNode* types, const TreeNode* dclns,
+                   vector<std::pair<uint32_t, string>>& found) {
+    for (const TreeNode* k = consts -> left.get(); k; k = k -> right.get()) {
+        const TreeNode* value = Child(k, 1);
+        int type = value -> kind == SUBC_CHAR ? TYPE_CHAR : TYPE_INTEGER;
+        if (value -> kind == SUBC_IDENTIFIER) {
+            const Typed_Name* other = Find_Name(scope, outer, Ident_Name(value));
+            type = other && other -> is_constant ? other -> type : TYPE_ERROR;
+            if (type == TYPE_ERROR)
+                Report_Error(found, value, "'" + Ident_Name(value) + "' is not a constant");
+        }
+        Declare_Name(scope, Child(k, 0), Typed_Name{true, type}, found);
+    }
+    for (const TreeNode* t = types -> left.get(); t; t = t -> right.get()) {
+        const string& name = Ident_Name(Child(t, 0));
+        int type = first_type + (int) type_names.size();
+        type_names.push_back(name);
+        if (!scope.types.emplace(name, type).second)
+            Report_Error(found, Child(t, 0), "type '" + name + "' is declared twice");
+        for (const TreeNode* lit = Child(t, 1) -> left.get(); lit; lit = lit -> right.get())
+            Declare_Name(scope, lit, Typed_Name{true, type}, found);
+    }
+    for (const TreeNode* dcln = dclns -> left.get(); dcln; dcln = dcln -> right.get()) {
+        int type = Resolve_Type(scope, outer, Child(dcln, dcln -> num_children - 1), found);
+        for (int i = 0; i < dcln -> num_children - 1; ++i)
+            Declare_Name(scope, Child(dcln, i), Typed_Name{false, type}, found);
     }
 }
 
-void Const() {
-    Name();
-    Read(T_equals);
-    ConstValue();
-    string s = "const";
-    Build_Tree(s, 2);
+void Declare_Name(Type_Scope& scope, const TreeNode* id, Typed_Name name, vector<std::pair<uint32_t, string>>& found) {
+    if (!scope.names.emplace(Ident_Name(id), name).second)
+        Report_Error(found, id, "'" + Ident_Name(id) + "' is declared twice");
 }
 
-void ConstValue() {
-    switch (Next_Token.token_type){
-        case INT:
-            Read(Next_Token);
+int Resolve_Type(const Type_Scope& scope, const Type_Scope* outer, const TreeNode* id,
+                 vector<std::pair<uint32_t, string>>& found) {
+    auto it = scope.types.find(Ident_Name(id));
+    if (it != scope.types.end())
+        return it -> second;
+    if (outer) {
+        it = outer -> types.find(Ident_Name(id));
+        if (it != outer -> types.end())
+            return it -> second;
+    }
+    Report_Error(found, id, "unknown type '" + Ident_Name(id) + "'");
+    return TYPE_ERROR;
+}
+
+// Checks function i, or the main block if i is past the last function,
+// adding what it finds to 'found'. Only reads G, so any number of these can
+// run at once.
+void Check_Function(const Check_Globals& G, size_t i, vector<std::pair<uint32_t, string>>& found) {
+    Type_Check C = Type_Check{G, nullptr, Type_Scope(), {}, {}, found, {}};
+    if (i == G.functions.size()) {
+        Check_Statement(C, Child(G.root, 5));
+        return;
+    }
+    C.f = &G.functions[i];
+    const TreeNode* fcn = C.f -> node;
+    C.local.names[Ident_Name(Child(fcn, 0))] = Typed_Name{false, C.f -> result};
+    size_t param = 0;
+    for (const TreeNode* dcln = Child(fcn, 1) -> left.get(); dcln; dcln = dcln -> right.get())
+        for (int k = 0; k < dcln -> num_children - 1; ++k)
+            Declare_Name(C.local, Child(dcln, k), Typed_Name{false, C.f -> params[param++]}, found);
+    Declare_Names(C.local, &G.scope, C.type_names, FIRST_ENUM_TYPE + (int) G.type_names.size(),
+                  Child(fcn, 3), Child(fcn, 4), Child(fcn, 5), found);
+    Check_Statement(C, Child(fcn, 6));
+}
+
+void Check_Statement(Type_Check& C, const TreeNode* s) {
+    switch (s -> kind) {
+        case SUBC_BLOCK:
+        case SUBC_LOOP:
+            for (const TreeNode* p = s -> left.get(); p; p = p -> right.get())
+                Check_Statement(C, p);
+            break;
+        case SUBC_ASSIGN: {
+            int type = Check_Variable(C, Child(s, 0));
+            Expect_Type(C, Child(s, 1), type, s);
+            break;
+        }
+        case SUBC_SWAP: {
+            int a = Check_Variable(C, Child(s, 0));
+            int b = Check_Variable(C, Child(s, 1));
+            if (a != b && a != TYPE_ERROR && b != TYPE_ERROR)
+                Report_Error(C.found, s, "'" + Ident_Name(Child(s, 0)) + "' is " + Type_Name(C, a) + " but '" +
+                                         Ident_Name(Child(s, 1)) + "' is " + Type_Name(C, b));
+            break;
+        }
+        case SUBC_OUTPUT:
+            // Booleans and enumerated types are printed as their ordinals
+            for (const TreeNode* p = s -> left.get(); p; p = p -> right.get())
+                if (p -> kind == SUBC_OUT_INTEGER)
+                    Check_Expression(C, Child(p, 0));
+            break;
+        case SUBC_IF:
+        case SUBC_WHILE:
+            Expect_Type(C, Child(s, 0), TYPE_BOOLEAN, s);
+            for (const TreeNode* p = Child(s, 1); p; p = p -> right.get())
+                Check_Statement(C, p);
+            break;
+        case SUBC_REPEAT: {
+            const TreeNode* cond = Child(s, s -> num_children - 1);
+            for (const TreeNode* p = s -> left.get(); p != cond; p = p -> right.get())
+                Check_Statement(C, p);
+            Expect_Type(C, cond, TYPE_BOOLEAN, s);
+            break;
+        }
+        case SUBC_FOR:
+            Check_Statement(C, Child(s, 0));
+            Expect_Type(C, Child(s, 1), TYPE_BOOLEAN, s);
+            Check_Statement(C, Child(s, 2));
+            Check_Statement(C, Child(s, 3));
+            break;
+        case SUBC_CASE: {
+            int type = Check_Expression(C, Child(s, 0));
+            for (const TreeNode* p = Child(s, 1); p; p = p -> right.get()) {
+                if (p -> kind == SUBC_OTHERWISE) {
+                    Check_Statement(C, Child(p, 0));
+                    continue;
+                }
+                for (int i = 0; i < p -> num_children - 1; ++i) {
+                    const TreeNode* label = Child(p, i);
+                    if (label -> kind == SUBC_RANGE) {
+                        Check_Case_Label(C, Child(label, 0), type, label);
+                        Check_Case_Label(C, Child(label, 1), type, label);
+                    } else {
+                        Check_Case_Label(C, label, type, p);
+                    }
+                }
+                Check_Statement(C, Child(p, p -> num_children - 1));
+            }
             break;
-        case CHAR:
-            Read(Next_Token);
+        }
+        case SUBC_READ:
+            for (const TreeNode* p = s -> left.get(); p; p = p -> right.get()) {
+                int type = Check_Variable(C, p);
+                if (type != TYPE_INTEGER && type != TYPE_CHAR && type != TYPE_ERROR)
+                    Report_Error(C.found, p, "'" + Ident_Name(p) + "' is " + Type_Name(C, type) +
+                                             "; only integers and chars can be read");
+            }
             break;
-        case ID:
-            Name();
+        case SUBC_RETURN:
+            if (C.f)
+                Expect_Type(C, Child(s, 0), C.f -> result, s);
+            else
+                Check_Expression(C, Child(s, 0));
             break;
         default:
-            throw runtime_error("Unresolved Next_Token.token_type in ConstValue()");
             break;
     }
+}
+
+// Returns the type of an expression, reporting any operand of the wrong
+// type on the way. Relational operators take two operands of any one type.
+// An operator with a wrong operand has TYPE_ERROR, so that whatever uses
+// its value does not report the same mistake again.
+int Check_Expression(Type_Check& C, const TreeNode* e) {
+    if (Is_Binary(e)) {
+        size_t base = C.spine.size();
+        for (; Is_Binary(e); e = Child(e, 0))
+            C.spine.push_back(e);
+        int a = Check_Expression(C, e);
+        while (C.spine.size() > base) {
+            const TreeNode* op = C.spine.back();
+            C.spine.pop_back();
+            a = Check_Binary(C, op, a);
+        }
+        return a;
+    }
+    switch (e -> kind) {
+        case SUBC_INTEGER:
+            return TYPE_INTEGER;
+        case SUBC_CHAR:
+            return TYPE_CHAR;
+        case SUBC_TRUE:
+        case SUBC_EOF:
+            return TYPE_BOOLEAN;
+        case SUBC_IDENTIFIER:
+            return Lookup_Typed(C, e).type;
+        case SUBC_CALL:
+            return Check_Call(C, e);
+        case SUBC_MINUS:
+        case SUBC_NOT: {
+            int type = e -> kind == SUBC_MINUS ? TYPE_INTEGER : TYPE_BOOLEAN;
+            return Expect_Type(C, Child(e, 0), type, e) ? type : TYPE_ERROR;
+        }
+        case SUBC_SUCC:
+        case SUBC_PRED:
+            return Check_Expression(C, Child(e, 0));
+        case SUBC_CHR:
+            return Expect_Type(C, Child(e, 0), TYPE_INTEGER, e) ? TYPE_CHAR : TYPE_ERROR;
+        case SUBC_ORD:
+            Check_Expression(C, Child(e, 0));
+            return TYPE_INTEGER;
+        default:
+            return TYPE_ERROR;
+    }
+}
+
+// Returns the type of binary operator e whose left operand has type a,
+// checking its right operand.
+int Check_Binary(Type_Check& C, const TreeNode* e, int a) {
+    const TreeNode* right = Child(e, 1);
+    if (e -> kind >= SUBC_LE && e -> kind <= SUBC_NE) {
+        int b = Check_Expression(C, right);
+        if (a != b && a != TYPE_ERROR && b != TYPE_ERROR)
+            Report_Error(C.found, e, string("'") + Kind_Names[e -> kind] + "' compares " + Type_Name(C, a) +
+                                     " with " + Type_Name(C, b));
+        return TYPE_BOOLEAN;
+    }
+    int type = e -> kind == SUBC_AND || e -> kind == SUBC_OR ? TYPE_BOOLEAN : TYPE_INTEGER;
+    bool ok = Match_Type(C, Child(e, 0), a, type, e);
+    ok = Expect_Type(C, right, type, e) && ok;
+    return ok ? type : (int) TYPE_ERROR;
+}
+
+int Check_Call(Type_Check& C, const TreeNode* e) {
+    const string& name = Ident_Name(Child(e, 0));
+    auto it = C.G.function_index.find(name);
+    const Signature* s = it == C.G.function_index.end() ? nullptr : &C.G.functions[it -> second];
+    size_t num_args = e -> num_children - 1;
+    if (!s)
+        Report_Error(C.found, e, "call to undefined function '" + name + "'");
+    else if (s -> params.size() != num_args)
+        Report_Error(C.found, e, "'" + name + "' takes " + std::to_string(s -> params.size()) + " arguments, not " +
+                                 std::to_string(num_args));
+    size_t i = 0;
+    for (const TreeNode* p = Child(e, 0) -> right.get(); p; p = p -> right.get(), ++i) {
+        if (s && s -> params.size() == num_args)
+            Expect_Type(C, p, s -> params[i], e);
+        else
+            Check_Expression(C, p);
+    }
+    return s ? s -> result : (int) TYPE_ERROR;
+}
+
+void Check_Case_Label(Type_Check& C, const TreeNode* label, int type, const TreeNode* user) {
+    if (label -> kind == SUBC_IDENTIFIER && !Lookup_Typed(C, label).is_constant)
+        Report_Error(C.found, label, "case label '" + Ident_Name(label) + "' is not a constant");
+    else
+        Expect_Type(C, label, type, user);
+}
+
+// Returns the type of a variable that is assigned, swapped or read, or
+// TYPE_ERROR if the name is a constant.
+int Check_Variable(Type_Check& C, const TreeNode* id) {
+    Typed_Name name = Lookup_Typed(C, id);
+    if (!name.is_constant)
+        return name.type;
+    Report_Error(C.found, id, "'" + Ident_Name(id) + "' is a constant, not a variable");
+    return TYPE_ERROR;
+}
+
+// Checks expression e, which 'user' (a statement, operator, call or case
+// label) needs to be of the expected type.
+bool Expect_Type(Type_Check& C, const TreeNode* e, int expected, const TreeNode* user) {
+    return Match_Type(C, e, Check_Expression(C, e), expected, user);
+}
 
+// The same for an e already found to be of the given type.
+bool Match_Type(Type_Check& C, const TreeNode* e, int type, int expected, const TreeNode* user) {
+    if (type == expected || type == TYPE_ERROR || expected == TYPE_ERROR)
+        return true;
+    Report_Error(C.found, e, Describe_Use(e, user) + " is " + Type_Name(C, type) + ", not " + Type_Name(C, expected));
+    return false;
 }
 
-void Types() {
-    int N = 1;
-    string s = "types";
-    if (Next_Token == T_type) {
-        Read(T_type);
-        Type();
-        Read(T_semicolon);
-        while (Next_Token.token_type == ID) {
-            Type();
-            Read(T_semicolon);
-            N++;
+// Names what e is to its user for a diagnostic; built only when one is.
+string Describe_Use(const TreeNode* e, const TreeNode* user) {
+    switch (user -> kind) {
+        case SUBC_ASSIGN:
+            return "the value assigned to '" + Ident_Name(Child(user, 0)) + "'";
+        case SUBC_IF:
+        case SUBC_WHILE:
+        case SUBC_REPEAT:
+        case SUBC_FOR:
+            return string("the condition of '") + Kind_Names[user -> kind] + "'";
+        case SUBC_RETURN:
+            return "the value returned";
+        case SUBC_CASE_CLAUSE:
+        case SUBC_RANGE:
+            return "the case label";
+        case SUBC_CALL: {
+            int i = 0;
+            for (const TreeNode* p = Child(user, 1); p != e; p = p -> right.get())
+                i++;
+            return "argument " + std::to_string(i + 1) + " of '" + Ident_Name(Child(user, 0)) + "'";
         }
-        Build_Tree(s, N);
-    } else {
-        Build_Tree(s, 0);
+        default:
+            return string("the operand of '") + Kind_Names[user -> kind] + "'";
+    }
+}
+
+const Typed_Name* Find_Name(const Type_Scope& scope, const Type_Scope* outer, const string& name) {
+    auto it = scope.names.find(name);
+    if (it != scope.names.end())
+        return &it -> second;
+    if (outer) {
+        it = outer -> names.find(name);
+        if (it != outer -> names.end())
+            return &it -> second;
     }
+    return nullptr;
+}
+
+Typed_Name Lookup_Typed(Type_Check& C, const TreeNode* id) {
+    const Typed_Name* name = Find_Name(C.local, &C.G.scope, Ident_Name(id));
+    if (name)
+        return *name;
+
+    // The interpreter makes an undeclared name an integer global (see
+    // Lookup()), so this only warns, once per function
+    if (C.undeclared.insert(Ident_Name(id)).second)
+        C.found.push_back(std::make_pair(id -> token.offset, "warning: '" + Ident_Name(id) +
+                                                             "' is not declared; it is taken to be an integer"));
+    return Typed_Name{false, TYPE_INTEGER};
 }
 
-void Type() {
-    Name();
-    Read(T_equals);
-    LitList();
-    string s = "type";
-    Build_Tree(s, 2);
+void Report_Error(vector<std::pair<uint32_t, string>>& found, const TreeNode* n, const string& msg) {
+    found.push_back(std::make_pair(n -> token.offset, "error: " + msg));
 }
 
-void LitList() {
-    int N = 1;
-    string s = "lit";
-    Read(T_open_parenthesis);
-    Name();
-    while (Next_Token == T_comma) {
-        Read(T_comma);
-        Name();
-        N++;
+string Type_Name(const Type_Check& C, int type) {
+    static const char* const builtin[] = {"<error>", "integer", "char", "boolean"};
+    if (type < FIRST_ENUM_TYPE)
+        return builtin[type];
+    size_t i = type - FIRST_ENUM_TYPE;
+    return i < C.G.type_names.size() ? C.G.type_names[i] : C.type_names[i - C.G.type_names.size()];
+}
+
+
+
+/**************************** AST DIFF ****************************/
+
+// Reports how program 'b' differs from program 'a': the functions added,
+// removed or changed, and inside the main program and each changed
+// function, the statements and declarations that differ. Only subtrees
+// whose hashes differ are entered, so the work grows with the change
+// rather than with the program.
+void Diff_Program(const TreeNode* a, const TreeNode* b, vector<Ast_Change>& changes) {
+    if (a -> hash != b -> hash)
+        Diff_Children(a, b, Ident_Name(Child(b, 0)), changes);
+}
+
+// Matches functions by name. Equal runs at either end are skipped by hash
+// first, since an edit usually leaves most functions where they were.
+void Diff_Functions(const TreeNode* a, const TreeNode* b, vector<Ast_Change>& changes) {
+    vector<const TreeNode*> x = Children(a), y = Children(b);
+    size_t lo = 0, hi_x = x.size(), hi_y = y.size();
+    while (lo < hi_x && lo < hi_y && x[lo] -> hash == y[lo] -> hash)
+        lo++;
+    while (hi_x > lo && hi_y > lo && x[hi_x - 1] -> hash == y[hi_y - 1] -> hash)
+        hi_x--, hi_y--;
+    unordered_map<string, const TreeNode*> before;
+    for (size_t i = lo; i < hi_x; ++i)
+        before[Ident_Name(Child(x[i], 0))] = x[i];
+    for (size_t i = lo; i < hi_y; ++i) {
+        const string& name = Ident_Name(Child(y[i], 0));
+        auto it = before.find(name);
+        if (it == before.end()) {
+            changes.push_back(Ast_Change{'+', name, nullptr, y[i]});
+            continue;
+        }
+        if (it -> second -> hash != y[i] -> hash) {
+            changes.push_back(Ast_Change{'~', name, it -> second, y[i]});
+            Diff_Children(it -> second, y[i], name, changes);
+        }
+        before.erase(it);
     }
-    Read(T_close_parenthesis);
-    Build_Tree(s, N);
+    for (size_t i = lo; i < hi_x; ++i)
+        if (before.count(Ident_Name(Child(x[i], 0))))
+            changes.push_back(Ast_Change{'-', Ident_Name(Child(x[i], 0)), x[i], nullptr});
 }
 
-void Dclns() {
-    int N = 1;
-    string s = "dclns";
-    if (Next_Token == T_var){
-        Read(T_var);
-        Dcln();
-        Read(T_semicolon);
-        while (Next_Token.token_type == ID) {
-            Dcln();
-            Read(T_semicolon);
-            N++;
+// Compares the children of two nodes of one kind whose hashes differ.
+// Equal runs at either end are skipped, the rest is matched by a longest
+// common subsequence of hashes, and what is left between matches pairs up
+// in order. Paired statements are compared in turn, and a statement left
+// without a pair is reported added or removed. Any other child that
+// differs is reported on its own directly under a program or function,
+// and as a change to its parent statement elsewhere.
+void Diff_Children(const TreeNode* a, const TreeNode* b, const string& where, vector<Ast_Change>& changes) {
+    vector<const TreeNode*> x = Children(a), y = Children(b);
+    size_t lo = 0, hi_x = x.size(), hi_y = y.size();
+    while (lo < hi_x && lo < hi_y && x[lo] -> hash == y[lo] -> hash)
+        lo++;
+    while (hi_x > lo && hi_y > lo && x[hi_x - 1] -> hash == y[hi_y - 1] -> hash)
+        hi_x--, hi_y--;
+    vector<std::pair<size_t, size_t>> matches = Common_Subsequence(x, lo, hi_x, y, lo, hi_y);
+    matches.push_back(std::make_pair(hi_x, hi_y));
+
+    bool top = a -> kind == SUBC_PROGRAM || a -> kind == SUBC_FCN;
+    bool changed = false;
+    size_t first = changes.size();
+    size_t i = lo, j = lo;
+    for (const std::pair<size_t, size_t>& match : matches) {
+        while (i < match.first || j < match.second) {
+            const TreeNode* p = i < match.first ? x[i] : nullptr;
+            const TreeNode* q = j < match.second ? y[j] : nullptr;
+            if (p && q && p -> kind == q -> kind) {
+                if (p -> hash == q -> hash)
+                    {}
+                else if (p -> kind == SUBC_SUBPROGS)
+                    Diff_Functions(p, q, changes);
+                else if (Is_Statement(p -> kind))
+                    Diff_Children(p, q, where, changes);
+                else if (top)
+                    changes.push_back(Ast_Change{'~', where, p, q});
+                else
+                    changed = true;
+                i++, j++;
+            } else if (p) {
+                if (Is_Statement(p -> kind))
+                    changes.push_back(Ast_Change{'-', where, p, nullptr});
+                else
+                    changed = true;
+                i++;
+            } else {
+                if (Is_Statement(q -> kind))
+                    changes.push_back(Ast_Change{'+', where, nullptr, q});
+                else
+                    changed = true;
+                j++;
+            }
         }
-        Build_Tree(s, N);
-    } else {
-        Build_Tree(s, 0);
-    }
-
-}
-
-void Dcln() {
-   int N = 1;
-   string s = "var";
-   Name();
-   while (Next_Token == T_comma) {
-       Read(T_comma);
-       Name();
-       N++;
-   }
-   Read(T_colon);
-   Name();
-   Build_Tree(s, N+1);
-}
-
-void SubProgs() {
-    int N = 0;
-    string s = "subprogs";
-    while (Next_Token == T_function) {
-        Fcn();
-        N++;
-    }
-    Build_Tree(s, N);
-}
-
-void Fcn() {
-    Read(T_function);
-    Name();
-    Read(T_open_parenthesis);
-    Params();
-    Read(T_close_parenthesis);
-    Read(T_colon);
-    Name();
-    Read(T_semicolon);
-    Consts();
-    Types();
-    Dclns();
-    Body();
-    Name();
-    Read(T_semicolon);
-    string s = "fcn";
-    Build_Tree(s, 8);
-}
-
-void Params() {
-    int N = 1;
-    string s = "params";
-    Dcln();
-    while (Next_Token == T_semicolon) {
-        Read(T_semicolon);
-        Dcln();
-        N++;
-    }
-    Build_Tree(s, N);
-}
-
-void Body() {
-    int N = 1;
-    string s = "block";
-    Read(T_begin);
-    Statement();
-    while (Next_Token == T_semicolon) {
-        Read(T_semicolon);
-        Statement();
-        N++;
-    }
-    Read(T_end);
-    Build_Tree(s, N);
-
-}
-
-void Statement() {
-    if (Next_Token.token_type == ID) {
-        Assignment();
-    } else{
-        int N = 1;
-        if (Next_Token == T_output) {
-            Read(T_output);
-            Read(T_open_parenthesis);
-            OutExp();
-            while (Next_Token == T_comma) {
-                Read(T_comma);
-                OutExp();
-                N++;
+        i = match.first + 1, j = match.second + 1;
+    }
+    if (changed)
+        changes.insert(changes.begin() + first, Ast_Change{'~', where, a, b});
+}
+
+// Pairs (i, j) with x[i] and y[j] of equal hash, increasing in both, as
+// many as there can be, for x[lo_x .. hi_x) and y[lo_y .. hi_y). Past a few
+// million table cells there are none, and Diff_Children() pairs the
+// children in order instead.
+vector<std::pair<size_t, size_t>> Common_Subsequence(const vector<const TreeNode*>& x, size_t lo_x, size_t hi_x,
+                                                     const vector<const TreeNode*>& y, size_t lo_y, size_t hi_y) {
+    vector<std::pair<size_t, size_t>> matches;
+    size_t m = hi_x - lo_x, n = hi_y - lo_y;
+    if (m == 0 || n == 0 || m * n > (1 << 22))
+        return matches;
+    // longest[i * (n + 1) + j]: length of the longest common subsequence of
+    // the suffixes from x[lo_x + i] and y[lo_y + j]
+    vector<uint32_t> longest((m + 1) * (n + 1), 0);
+    for (size_t i = m; i-- > 0;)
+        for (size_t j = n; j-- > 0;)
+            longest[i * (n + 1) + j] = x[lo_x + i] -> hash == y[lo_y + j] -> hash
+                                           ? longest[(i + 1) * (n + 1) + j + 1] + 1
+                                           : std::max(longest[(i + 1) * (n + 1) + j], longest[i * (n + 1) + j + 1]);
+    for (size_t i = 0, j = 0; i < m && j < n;) {
+        if (x[lo_x + i] -> hash == y[lo_y + j] -> hash)
+            matches.push_back(std::make_pair(lo_x + i++, lo_y + j++));
+        else if (longest[(i + 1) * (n + 1) + j] >= longest[i * (n + 1) + j + 1])
+            i++;
+        else
+            j++;
+    }
+    return matches;
+}
+
+vector<const TreeNode*> Children(const TreeNode* n) {
+    vector<const TreeNode*> children;
+    for (const TreeNode* c = n -> left.get(); c; c = c -> right.get())
+        children.push_back(c);
+    return children;
+}
+
+// The nodes 'p1 -astdiff' reports on their own: statements, and the
+// clauses of a case, which hold statements.
+bool Is_Statement(subc_kind kind) {
+    return (kind >= SUBC_BLOCK && kind <= SUBC_SWAP) || kind == SUBC_CASE_CLAUSE || kind == SUBC_OTHERWISE;
+}
+
+
+
+/**************************** READAHEAD ****************************/
+
+// Starts reading the first files of 'paths'. Without io_uring, or with
+// 'use_ring' false, a few worker threads do the reads instead.
+void Start_Readahead(Readahead& R, const vector<string>& paths, size_t depth, bool use_ring) {
+    for (const string& path : paths)
+        R.files.push_back(Batch_File{path, string(), -1, 0, 0, false, {}, {}});
+    // Each file in the window holds a descriptor until it is read, so a
+    // window near RLIMIT_NOFILE would fail opens with EMFILE. Half the limit
+    // leaves the rest to the process.
+    rlimit files;
+    if (getrlimit(RLIMIT_NOFILE, &files) == 0 && files.rlim_cur != RLIM_INFINITY)
+        depth = std::min<size_t>(depth, std::max<size_t>(1, files.rlim_cur / 2));
+    R.depth = depth;
+    R.issued = R.taken = R.next_read = 0;
+    R.stopping = false;
+    R.waited_ms = 0;
+    R.ring = false;
+#ifdef SUBC_IO_URING
+    // The window and Stop_Readahead()'s no-op must fit in the ring
+    R.ring = use_ring && Ring_Setup(R.io, (unsigned) std::min<size_t>(depth + 2, 4096));
+    if (R.ring) {
+        R.depth = std::min<size_t>(depth, 4094);
+        R.workers.push_back(std::thread(Ring_Reaper, &R));
+    }
+#endif
+    if (!R.ring)
+        for (size_t t = 0; t < std::max<size_t>(1, std::min<size_t>(depth, 8)); ++t)
+            R.workers.push_back(std::thread(Read_Worker, &R));
+    Issue_Reads(R, R.depth + 1);
+}
+
+// Waits until the next file is read, hands it over and starts reading the
+// file that enters the window behind it.
+Batch_File& Take_File(Readahead& R) {
+    Batch_File& f = R.files[R.taken];
+    auto start = std::chrono::steady_clock::now();
+    Issue_Reads(R, R.taken + 1);
+    {
+        std::unique_lock<std::mutex> hold(R.lock);
+        R.changed.wait(hold, [&f] { return f.ready; });
+    }
+    R.waited_ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    R.taken++;
+    Issue_Reads(R, R.taken + R.depth);
+    return f;
+}
+
+// Must only be called once every file has been taken.
+void Stop_Readahead(Readahead& R) {
+    {
+        std::lock_guard<std::mutex> hold(R.lock);
+        R.stopping = true;
+#ifdef SUBC_IO_URING
+        if (R.ring)
+            Ring_Nop(R.io, UINT64_MAX);     // wakes the reaper
+#endif
+    }
+    R.changed.notify_all();
+    for (std::thread& t : R.workers)
+        t.join();
+    R.workers.clear();
+#ifdef SUBC_IO_URING
+    if (R.ring)
+        Ring_Close(R.io);
+#endif
+}
+
+// Starts reading every file before 'until' that is not started yet.
+void Issue_Reads(Readahead& R, size_t until) {
+    while (R.issued < R.files.size() && R.issued < until) {
+        Batch_File& f = R.files[R.issued];
+        Open_Batch_File(f);
+        if (!R.ring && f.fd >= 0)
+            posix_fadvise(f.fd, 0, 0, POSIX_FADV_WILLNEED);
+        std::lock_guard<std::mutex> hold(R.lock);
+#ifdef SUBC_IO_URING
+        if (R.ring && f.fd >= 0 && !f.text.empty()) {
+            Ring_Read(R.io, f, R.issued);
+        } else if (R.ring) {
+            Read_Batch_File(f);     // nothing to read
+            f.ready = true;
+        }
+#endif
+        R.issued++;
+        R.changed.notify_all();
+    }
+}
+
+// Opens a file and sizes its text, or sets its error.
+void Open_Batch_File(Batch_File& f) {
+    f.issued = std::chrono::steady_clock::now();
+    struct stat st;
+    f.fd = open(f.path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (f.fd < 0 || fstat(f.fd, &st) != 0) {
+        f.error = errno;
+        return;
+    }
+    f.text.resize(st.st_size);
+}
+
+// Reads the rest of a file with read(), then closes it. The caller marks
+// it ready.
+void Read_Batch_File(Batch_File& f) {
+    while (f.fd >= 0 && !f.error && f.done < f.text.size()) {
+        ssize_t n = read(f.fd, &f.text[f.done], f.text.size() - f.done);
+        if (n < 0 && errno != EINTR)
+            f.error = errno;
+        else if (n == 0)
+            f.text.resize(f.done);      // the file shrank
+        else if (n > 0)
+            f.done += n;
+    }
+    if (f.fd >= 0)
+        close(f.fd);
+    f.fd = -1;
+    f.finished = std::chrono::steady_clock::now();
+}
+
+// Reads the files started by Issue_Reads() in order, several at a time.
+void Read_Worker(Readahead* R) {
+    std::unique_lock<std::mutex> hold(R -> lock);
+    while (true) {
+        R -> changed.wait(hold, [R] { return R -> stopping || R -> next_read < R -> issued; });
+        if (R -> stopping)
+            return;
+        Batch_File& f = R -> files[R -> next_read++];
+        hold.unlock();
+        Read_Batch_File(f);
+        hold.lock();
+        f.ready = true;
+        R -> changed.notify_all();
+    }
+}
+
+// How long at least one read was in flight.
+double Io_Busy_Ms(const vector<Batch_File>& files) {
+    std::chrono::duration<double, std::milli> busy(0);
+    std::chrono::steady_clock::time_point until;
+    for (const Batch_File& f : files) {     // started in order
+        if (f.finished <= until)
+            continue;
+        busy += f.finished - std::max(f.issued, until);
+        until = f.finished;
+    }
+    return busy.count();
+}
+
+#ifdef SUBC_IO_URING
+// Sets up an io_uring with room for 'entries' reads, or returns false if
+// the kernel does not offer it (too old, or disabled by a sandbox).
+bool Ring_Setup(Io_Ring& ring, unsigned entries) {
+    io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    ring.fd = (int) syscall(__NR_io_uring_setup, entries, &p);
+    if (ring.fd < 0)
+        return false;
+    ring.sq_map_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    ring.cq_map_len = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+    ring.sqes_len = p.sq_entries * sizeof(io_uring_sqe);
+    ring.sq_map = mmap(nullptr, ring.sq_map_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                       ring.fd, IORING_OFF_SQ_RING);
+    ring.cq_map = mmap(nullptr, ring.cq_map_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                       ring.fd, IORING_OFF_CQ_RING);
+    void* sqes = mmap(nullptr, ring.sqes_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      ring.fd, IORING_OFF_SQES);
+    if (ring.sq_map == MAP_FAILED || ring.cq_map == MAP_FAILED || sqes == MAP_FAILED) {
+        if (ring.sq_map != MAP_FAILED)
+            munmap(ring.sq_map, ring.sq_map_len);
+        if (ring.cq_map != MAP_FAILED)
+            munmap(ring.cq_map, ring.cq_map_len);
+        if (sqes != MAP_FAILED)
+            munmap(sqes, ring.sqes_len);
+        close(ring.fd);
+        return false;
+    }
+    char* sq = (char*) ring.sq_map;
+    char* cq = (char*) ring.cq_map;
+    ring.sq_head = (unsigned*) (sq + p.sq_off.head);
+    ring.sq_tail = (unsigned*) (sq + p.sq_off.tail);
+    ring.sq_mask = (unsigned*) (sq + p.sq_off.ring_mask);
+    ring.sq_array = (unsigned*) (sq + p.sq_off.array);
+    ring.cq_head = (unsigned*) (cq + p.cq_off.head);
+    ring.cq_tail = (unsigned*) (cq + p.cq_off.tail);
+    ring.cq_mask = (unsigned*) (cq + p.cq_off.ring_mask);
+    ring.cqes = (io_uring_cqe*) (cq + p.cq_off.cqes);
+    ring.sqes = (io_uring_sqe*) sqes;
+    return true;
+}
+
+// Submits a read of the rest of 'f', to complete with user_data 'id'. The
+// window never holds more files than the ring has entries, and each file
+// has one read in flight at most, so there is always a free entry.
+// Submissions come from two threads, so they hold Readahead::lock.
+void Ring_Read(Io_Ring& ring, Batch_File& f, uint64_t id) {
+    unsigned tail = *ring.sq_tail;
+    unsigned index = tail & *ring.sq_mask;
+    io_uring_sqe* sqe = &ring.sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe -> opcode = IORING_OP_READ;
+    sqe -> fd = f.fd;
+    sqe -> addr = (uint64_t) (uintptr_t) &f.text[f.done];
+    sqe -> len = (uint32_t) std::min<size_t>(f.text.size() - f.done, 1u << 30);
+    sqe -> off = f.done;
+    sqe -> user_data = id;
+    ring.sq_array[index] = index;
+    __atomic_store_n(ring.sq_tail, tail + 1, __ATOMIC_RELEASE);
+    while (syscall(__NR_io_uring_enter, ring.fd, 1, 0, 0, nullptr, 0) < 0 && errno == EINTR)
+        ;
+}
+
+// Submits a no-op that completes with user_data 'id'.
+void Ring_Nop(Io_Ring& ring, uint64_t id) {
+    unsigned tail = *ring.sq_tail;
+    unsigned index = tail & *ring.sq_mask;
+    io_uring_sqe* sqe = &ring.sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe -> opcode = IORING_OP_NOP;
+    sqe -> user_data = id;
+    ring.sq_array[index] = index;
+    __atomic_store_n(ring.sq_tail, tail + 1, __ATOMIC_RELEASE);
+    while (syscall(__NR_io_uring_enter, ring.fd, 1, 0, 0, nullptr, 0) < 0 && errno == EINTR)
+        ;
+}
+
+// Waits for reads to complete, marking each file ready as its last read
+// does, so that 'finished' is when the data arrived rather than when the
+// parser next looked. A short read is resubmitted for the rest of the
+// file. Returns on the no-op that Stop_Readahead() submits.
+void Ring_Reaper(Readahead* R) {
+    Io_Ring& ring = R -> io;
+    bool stopped = false;
+    while (!stopped) {
+        while (syscall(__NR_io_uring_enter, ring.fd, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0) < 0 && errno == EINTR)
+            ;
+        std::lock_guard<std::mutex> hold(R -> lock);
+        unsigned head = *ring.cq_head;
+        unsigned tail = __atomic_load_n(ring.cq_tail, __ATOMIC_ACQUIRE);
+        for (; head != tail; ++head) {
+            const io_uring_cqe& cqe = ring.cqes[head & *ring.cq_mask];
+            if (cqe.user_data == UINT64_MAX) {
+                stopped = true;
+                continue;
             }
-            Read(T_close_parenthesis);
-            string s = "output";
-            Build_Tree(s, N);
-        } else if (Next_Token == T_if) {
-            Read(T_if);
-            Expression();
-            Read(T_then);
-            Statement();
-            if (Next_Token == T_else) {
-                Read(T_else);
-                Statement();
-                N++;
+            Batch_File& f = R -> files[cqe.user_data];
+            if (cqe.res < 0 && cqe.res != -EINTR && cqe.res != -EAGAIN)
+                f.error = -cqe.res;
+            else if (cqe.res == 0)
+                f.text.resize(f.done);      // the file shrank
+            else if (cqe.res > 0)
+                f.done += cqe.res;
+            if (!f.error && f.done < f.text.size()) {
+                Ring_Read(ring, f, cqe.user_data);
+            } else {
+                Read_Batch_File(f);     // closes it
+                f.ready = true;
             }
-            string s = "if";
-            Build_Tree(s, N+1);
-        } else if (Next_Token == T_while) {
-            Read(T_while);
-            Expression();
-            Read(T_do);
-            Statement();
-            string s = "while";
-            Build_Tree(s, 2);
-        } else if (Next_Token == T_repeat) {
-            Read(T_repeat);
-            Statement();
-            while (Next_Token == T_semicolon) {
-                Read(T_semicolon);
-                Statement();
-                N++;
+        }
+        __atomic_store_n(ring.cq_head, head, __ATOMIC_RELEASE);
+        R -> changed.notify_all();
+    }
+}
+
+void Ring_Close(Io_Ring& ring) {
+    munmap(ring.sq_map, ring.sq_map_len);
+    munmap(ring.cq_map, ring.cq_map_len);
+    munmap(ring.sqes, ring.sqes_len);
+    close(ring.fd);
+}
+#endif
+
+
+
+/**************************** INTERPRETER ****************************/
+
+struct Run_State {
+    Program_Info& P;
+    vector<int64_t> globals;
+    vector<const TreeNode*> spine;  // operators of the chains being evaluated; see Is_Binary()
+};
+
+void Interpret(Program_Info& P) {
+    Run_State R = Run_State{P, vector<int64_t>(P.num_globals, 0), {}};
+    vector<int64_t> frame;
+    if (Exec(R, nullptr, frame, Child(P.root, 5)) == EXIT)
+        Runtime_Error("exit outside of a loop");
+    fflush(stdout);
+}
+
+void Runtime_Error(const string& msg) {
+    fflush(stdout);
+    throw runtime_error("Runtime error: " + msg);
+}
+
+int Input_Skip_Space() {
+    int ch;
+    do
+        ch = getchar();
+    while (ch != EOF && isspace(ch));
+    return ch;
+}
+
+bool Input_Eof() {
+    int ch = Input_Skip_Space();
+    if (ch == EOF)
+        return true;
+    ungetc(ch, stdin);
+    return false;
+}
+
+int64_t Input_Int() {
+    int ch = Input_Skip_Space();
+    bool negative = false;
+    uint64_t n = 0;
+    if (ch == EOF)
+        Runtime_Error("read past end of input");
+    if (ch == '-' || ch == '+') {
+        negative = ch == '-';
+        ch = getchar();
+    }
+    if (ch == EOF || !isdigit(ch))
+        Runtime_Error("invalid integer input");
+    while (ch != EOF && isdigit(ch)) {
+        n = n * 10 + (ch - '0');
+        ch = getchar();
+    }
+    if (ch != EOF)
+        ungetc(ch, stdin);
+    return (int64_t) (negative ? 0 - n : n);
+}
+
+int64_t Input_Char() {
+    int ch = Input_Skip_Space();
+    if (ch == EOF)
+        Runtime_Error("read past end of input");
+    return ch;
+}
+
+int64_t Call_Function(Run_State& R, Function_Info& f, vector<int64_t>& args) {
+    vector<int64_t> frame(f.num_slots, 0);
+    for (int i = 0; i < f.num_params; ++i)
+        frame[i + 1] = args[i];
+    if (Exec(R, &f, frame, Child(f.node, 6)) == EXIT)
+        Runtime_Error("exit outside of a loop in " + f.name);
+    return frame[0];
+}
+
+int64_t& Variable(Run_State& R, Function_Info* f, vector<int64_t>& frame, const string& name) {
+    Symbol sym = Lookup(R.P, f, name);
+    if (sym.kind == CONSTANT)
+        throw runtime_error(name + " is not a variable");
+    if (sym.kind == LOCAL_VAR)
+        return frame[sym.value];
+    if (sym.value >= (int64_t) R.globals.size())
+        R.globals.resize(R.P.num_globals, 0);
+    return R.globals[sym.value];
+}
+
+Flow Exec(Run_State& R, Function_Info* f, vector<int64_t>& frame, const TreeNode* s) {
+    switch (s -> kind) {
+        case SUBC_BLOCK:
+            for (const TreeNode* p = s -> left.get(); p; p = p -> right.get()) {
+                Flow flow = Exec(R, f, frame, p);
+                if (flow != NORMAL)
+                    return flow;
             }
-            Read(T_until);
-            Expression();
-            string s = "repeat";
-            Build_Tree(s, N+1);
-        } else if (Next_Token == T_for) {
-            Read(T_for);
-            Read(T_open_parenthesis);
-            ForStat();
-            Read(T_semicolon);
-            ForExp();
-            Read(T_semicolon);
-            ForStat();
-            Read(T_close_parenthesis);
-            Statement();
-            string s = "for";
-            Build_Tree(s, 4);
-        } else if (Next_Token == T_loop) {
-            Read(T_loop);
-            Statement();
-            while (Next_Token == T_semicolon) {
-                Read(T_semicolon);
-                Statement();
-                N++;
+            break;
+        case SUBC_ASSIGN: {
+            int64_t v = Eval(R, f, frame, Child(s, 1));
+            Variable(R, f, frame, Ident_Name(Child(s, 0))) = v;
+            break;
+        }
+        case SUBC_SWAP: {
+            int64_t a = Variable(R, f, frame, Ident_Name(Child(s, 0)));
+            int64_t b = Variable(R, f, frame, Ident_Name(Child(s, 1)));
+            Variable(R, f, frame, Ident_Name(Child(s, 0))) = b;
+            Variable(R, f, frame, Ident_Name(Child(s, 1))) = a;
+            break;
+        }
+        case SUBC_OUTPUT: {
+            bool prev_char = false;
+            for (const TreeNode* p = s -> left.get(); p; p = p -> right.get()) {
+                bool first = p == s -> left.get();
+                if (p -> kind == SUBC_OUT_STRING) {
+                    if (!first)
+                        putchar(' ');
+                    fputs(subc::Node(Child(p, 0)).string_value().c_str(), stdout);
+                    prev_char = false;
+                } else {
+                    bool is_char = Is_Char_Expr(R.P, f, Child(p, 0));
+                    int64_t v = Eval(R, f, frame, Child(p, 0));
+                    if (!first && !(prev_char && is_char))
+                        putchar(' ');
+                    if (is_char)
+                        putchar((int) (unsigned char) v);
+                    else
+                        printf("%lld", (long long) v);
+                    prev_char = is_char;
+                }
             }
-            Read(T_pool);
-            string s = "loop";
-            Build_Tree(s, N);
-        } else if (Next_Token == T_case) {
-            Read(T_case);
-            Expression();
-            Read(T_of);
-            Caseclause();
-            Read(T_semicolon);
-            while (Next_Token.token_type == ID || Next_Token.token_type == CHAR
-                   ||Next_Token.token_type == INT) {
-                Caseclause();
-                Read(T_semicolon);
-                N++;
+            putchar('\n');
+            break;
+        }
+        case SUBC_IF:
+            if (Eval(R, f, frame, Child(s, 0)) != 0)
+                return Exec(R, f, frame, Child(s, 1));
+            else if (s -> num_children == 3)
+                return Exec(R, f, frame, Child(s, 2));
+            break;
+        case SUBC_WHILE:
+            while (Eval(R, f, frame, Child(s, 0)) != 0) {
+                Flow flow = Exec(R, f, frame, Child(s, 1));
+                if (flow != NORMAL)
+                    return flow;
+            }
+            break;
+        case SUBC_REPEAT: {
+            const TreeNode* cond = Child(s, s -> num_children - 1);
+            do {
+                for (const TreeNode* p = s -> left.get(); p != cond; p = p -> right.get()) {
+                    Flow flow = Exec(R, f, frame, p);
+                    if (flow != NORMAL)
+                        return flow;
+                }
+            } while (Eval(R, f, frame, cond) == 0);
+            break;
+        }
+        case SUBC_FOR:
+            Exec(R, f, frame, Child(s, 0));
+            while (Eval(R, f, frame, Child(s, 1)) != 0) {
+                Flow flow = Exec(R, f, frame, Child(s, 3));
+                if (flow != NORMAL)
+                    return flow;
+                Exec(R, f, frame, Child(s, 2));
             }
-            int P = 0;
-            if (Next_Token == T_otherwise)
-                P++;
-            OtherwiseClause();
-            Read(T_end);
-            string s = "case";
-            Build_Tree(s, N+P+1);
-        } else if (Next_Token == T_read) {
-            Read(T_read);
-            Read(T_open_parenthesis);
-            Name();
-            while (Next_Token == T_comma) {
-                Read(T_comma);
-                Name();
-                N++;
+            break;
+        case SUBC_LOOP:
+            while (true) {
+                for (const TreeNode* p = s -> left.get(); p; p = p -> right.get()) {
+                    Flow flow = Exec(R, f, frame, p);
+                    if (flow == EXIT)
+                        return NORMAL;
+                    if (flow == RETURN)
+                        return RETURN;
+                }
             }
-            Read(T_close_parenthesis);
-            string s = "read";
-            Build_Tree(s, N);
-        } else if (Next_Token == T_exit) {
-            Read(T_exit);
-            string s = "exit";
-            Build_Tree(s, 0);
-        } else if (Next_Token == T_return) {
-            Read(T_return);
-            Expression();
-            string s = "return";
-            Build_Tree(s, 1);
-        } else if (Next_Token == T_begin) {
-            Body();
-        } else {
-            string s = "<null>";
-            Build_Tree(s, 0);
+        case SUBC_CASE: {
+            int64_t v = Eval(R, f, frame, Child(s, 0));
+            for (const TreeNode* p = Child(s, 1); p; p = p -> right.get()) {
+                if (p -> kind == SUBC_OTHERWISE)
+                    return Exec(R, f, frame, Child(p, 0));
+                for (int i = 0; i < p -> num_children - 1; ++i) {
+                    const TreeNode* label = Child(p, i);
+                    bool match;
+                    if (label -> kind == SUBC_RANGE)
+                        match = v >= Case_Label_Value(R.P, f, Child(label, 0)) &&
+                                v <= Case_Label_Value(R.P, f, Child(label, 1));
+                    else
+                        match = v == Case_Label_Value(R.P, f, label);
+                    if (match)
+                        return Exec(R, f, frame, Child(p, p -> num_children - 1));
+                }
+            }
+            break;
+        }
+        case SUBC_READ:
+            for (const TreeNode* p = s -> left.get(); p; p = p -> right.get()) {
+                int64_t v = Lookup(R.P, f, Ident_Name(p)).is_char ? Input_Char() : Input_Int();
+                Variable(R, f, frame, Ident_Name(p)) = v;
+            }
+            break;
+        case SUBC_EXIT:
+            return EXIT;
+        case SUBC_RETURN: {
+            int64_t v = Eval(R, f, frame, Child(s, 0));
+            if (f)
+                frame[0] = v;
+            return RETURN;
+        }
+        case SUBC_NULL:
+            break;
+        default:
+            throw runtime_error("Could not resolve statement " + s -> token.value + " in Exec()");
+    }
+    return NORMAL;
+}
+
+int64_t Eval(Run_State& R, Function_Info* f, vector<int64_t>& frame, const TreeNode* e) {
+    switch (e -> kind) {
+        case SUBC_INTEGER:
+        case SUBC_CHAR:
+            return Literal_Value(e);
+        case SUBC_IDENTIFIER: {
+            Symbol sym = Lookup(R.P, f, Ident_Name(e));
+            if (sym.kind == CONSTANT)
+                return sym.value;
+            return Variable(R, f, frame, Ident_Name(e));
+        }
+        case SUBC_CALL: {
+            vector<int64_t> args;
+            for (const TreeNode* p = Child(e, 1); p; p = p -> right.get())
+                args.push_back(Eval(R, f, frame, p));
+            return Call_Function(R, Lookup_Function(R.P, Ident_Name(Child(e, 0)), e -> num_children - 1), args);
+        }
+        case SUBC_EOF:
+            return Input_Eof();
+        case SUBC_TRUE:
+            return 1;
+        default:
+            break;
+    }
+    if (Is_Binary(e)) {
+        size_t base = R.spine.size();
+        for (; Is_Binary(e); e = Child(e, 0))
+            R.spine.push_back(e);
+        int64_t a = Eval(R, f, frame, e);
+        while (R.spine.size() > base) {
+            const TreeNode* op = R.spine.back();
+            R.spine.pop_back();
+            a = Apply_Binary(op, a, Eval(R, f, frame, Child(op, 1)));
+        }
+        return a;
+    }
+    if (e -> num_children == 1) {
+        uint64_t v = (uint64_t) Eval(R, f, frame, Child(e, 0));
+        switch (e -> kind) {
+            case SUBC_MINUS:
+                return (int64_t) (0 - v);
+            case SUBC_NOT:
+                return v == 0;
+            case SUBC_SUCC:
+                return (int64_t) (v + 1);
+            case SUBC_PRED:
+                return (int64_t) (v - 1);
+            case SUBC_CHR:
+            case SUBC_ORD:
+                return (int64_t) v;
+            default:
+                throw runtime_error("Could not resolve unary operator " + e -> token.value + " in Eval()");
+        }
+    }
+    throw runtime_error("Could not resolve expression " + e -> token.value + " in Eval()");
+}
+
+int64_t Apply_Binary(const TreeNode* e, int64_t a, int64_t b) {
+    switch (e -> kind) {
+        case SUBC_PLUS:
+            return (int64_t) ((uint64_t) a + (uint64_t) b);
+        case SUBC_MINUS:
+            return (int64_t) ((uint64_t) a - (uint64_t) b);
+        case SUBC_TIMES:
+            return (int64_t) ((uint64_t) a * (uint64_t) b);
+        case SUBC_DIVIDE:
+        case SUBC_MOD:
+            if (b == 0)
+                Runtime_Error("division by zero");
+            if (b == -1)
+                return e -> kind == SUBC_DIVIDE ? (int64_t) (0 - (uint64_t) a) : 0;
+            return e -> kind == SUBC_DIVIDE ? a / b : a % b;
+        case SUBC_AND:
+            return a != 0 && b != 0;
+        case SUBC_OR:
+            return a != 0 || b != 0;
+        case SUBC_LT:
+            return a < b;
+        case SUBC_LE:
+            return a <= b;
+        case SUBC_GT:
+            return a > b;
+        case SUBC_GE:
+            return a >= b;
+        case SUBC_EQ:
+            return a == b;
+        case SUBC_NE:
+            return a != b;
+        default:
+            throw runtime_error("Could not resolve binary operator " + e -> token.value + " in Eval()");
+    }
+}
+
+
+
+/**************************** CODEGEN ****************************/
+
+// Emits x86-64 GNU assembler (AT&T syntax) for the whole program. Values are
+// 64-bit integers kept in %rax; operands are spilled to the machine stack.
+// Arguments are pushed left to right and popped by the caller; the callee
+// keeps its result in slot 0 of its frame. I/O goes through runtime/subc_rt.c.
+struct Gen_State {
+    Program_Info& P;
+    ostream& o;
+    int labels;
+    string return_label;
+    vector<string> exit_labels;
+    vector<string> strings;
+    vector<const TreeNode*> spine;  // operators of the chains being generated; see Is_Binary()
+};
+
+void Generate_Program(Program_Info& P, ostream& o) {
+    Gen_State G = Gen_State{P, o, 0, "", {}, {}, {}};
+    o << "\t.text" << endl;
+    for (Function_Info& f : P.functions)
+        Gen_Function(G, f);
+
+    G.return_label = New_Label(G);
+    o << "\t.globl main" << endl
+      << "\t.type main, @function" << endl
+      << "main:" << endl
+      << "\tpushq %rbp" << endl
+      << "\tmovq %rsp, %rbp" << endl
+      << "\tpushq %rbx" << endl
+      << "\tsubq $8, %rsp" << endl;
+    Gen_Statement(G, nullptr, Child(P.root, 5));
+    o << G.return_label << ":" << endl
+      << "\txorl %eax, %eax" << endl
+      << "\tmovq -8(%rbp), %rbx" << endl
+      << "\tleave" << endl
+      << "\tret" << endl;
+
+    o << "\t.section .rodata" << endl;
+    for (size_t i = 0; i < G.strings.size(); ++i) {
+        o << ".LS" << i << ":" << endl << "\t.string \"";
+        for (unsigned char ch : G.strings[i]) {
+            if (ch == '\\' || ch == '\"')
+                o << '\\' << ch;
+            else if (ch < ' ' || ch > '~')
+                o << '\\' << (char) ('0' + (ch >> 6)) << (char) ('0' + ((ch >> 3) & 7)) << (char) ('0' + (ch & 7));
+            else
+                o << ch;
         }
+        o << "\"" << endl;
     }
+    vector<string> globals(P.num_globals);
+    for (auto& entry : P.scope)
+        if (entry.second.kind == GLOBAL_VAR)
+            globals[entry.second.value] = entry.first;
+    for (const string& name : globals)
+        o << "\t.lcomm G_" << name << ", 8" << endl;
+    o << "\t.section .note.GNU-stack,\"\",@progbits" << endl;
+}
+
+void Gen_Function(Gen_State& G, Function_Info& f) {
+    int locals = f.num_slots - f.num_params;
+    G.return_label = New_Label(G);
+    G.exit_labels.clear();
+    G.o << "F_" << f.name << ":" << endl
+        << "\tpushq %rbp" << endl
+        << "\tmovq %rsp, %rbp" << endl
+        << "\tsubq $" << 8 * locals << ", %rsp" << endl;
+    for (int i = 1; i <= locals; ++i)
+        G.o << "\tmovq $0, " << -8 * i << "(%rbp)" << endl;
+    Gen_Statement(G, &f, Child(f.node, 6));
+    G.o << "\tmovq -8(%rbp), %rax" << endl
+        << G.return_label << ":" << endl
+        << "\tleave" << endl
+        << "\tret" << endl;
+}
+
+string New_Label(Gen_State& G) {
+    return ".L" + std::to_string(G.labels++);
+}
+
+string Gen_Variable(Gen_State& G, Function_Info* f, const string& name) {
+    Symbol sym = Lookup(G.P, f, name);
+    if (sym.kind == CONSTANT)
+        throw runtime_error(name + " is not a variable");
+    if (sym.kind == GLOBAL_VAR)
+        return "G_" + name + "(%rip)";
+    if (sym.value == 0)
+        return "-8(%rbp)";
+    if (sym.value <= f -> num_params)
+        return std::to_string(16 + 8 * (f -> num_params - sym.value)) + "(%rbp)";
+    return std::to_string(-8 * (sym.value - f -> num_params + 1)) + "(%rbp)";
 }
 
-void Assignment() {
-    Name();
-    if (Next_Token == T_colon_equals) {
-        Read(T_colon_equals);
-        Expression();
-        string s = "assign";
-        Build_Tree(s, 2);
+// Emits 'op $v, reg', going through %rdx when v does not fit an imm32.
+void Gen_Immediate(Gen_State& G, const string& op, int64_t v, const string& reg) {
+    if (v >= INT32_MIN && v <= INT32_MAX) {
+        G.o << "\t" << op << " $" << v << ", " << reg << endl;
+    } else {
+        G.o << "\tmovabsq $" << v << ", %rdx" << endl
+            << "\t" << op << " %rdx, " << reg << endl;
+    }
+}
+
+// Runtime calls follow the SysV ABI, so realign %rsp around them. %rbx is
+// callee-saved by the C runtime and never holds a live value otherwise.
+void Gen_Runtime_Call(Gen_State& G, const string& fn) {
+    G.o << "\tmovq %rsp, %rbx" << endl
+        << "\tandq $-16, %rsp" << endl
+        << "\tcall " << fn << endl
+        << "\tmovq %rbx, %rsp" << endl;
+}
+
+void Gen_Statement(Gen_State& G, Function_Info* f, const TreeNode* s) {
+    ostream& o = G.o;
+    subc_kind k = s -> kind;
+    if (k == SUBC_BLOCK) {
+        for (const TreeNode* p = s -> left.get(); p; p = p -> right.get())
+            Gen_Statement(G, f, p);
+    } else if (k == SUBC_ASSIGN) {
+        Gen_Expression(G, f, Child(s, 1));
+        o << "\tmovq %rax, " << Gen_Variable(G, f, Ident_Name(Child(s, 0))) << endl;
+    } else if (k == SUBC_SWAP) {
+        string a = Gen_Variable(G, f, Ident_Name(Child(s, 0)));
+        string b = Gen_Variable(G, f, Ident_Name(Child(s, 1)));
+        o << "\tmovq " << a << ", %rax" << endl
+          << "\tmovq " << b << ", %rcx" << endl
+          << "\tmovq %rcx, " << a << endl
+          << "\tmovq %rax, " << b << endl;
+    } else if (k == SUBC_OUTPUT) {
+        bool prev_char = false;
+        for (const TreeNode* p = s -> left.get(); p; p = p -> right.get()) {
+            bool first = p == s -> left.get();
+            if (p -> kind == SUBC_OUT_STRING) {
+                o << "\tleaq .LS" << G.strings.size() << "(%rip), %rdi" << endl
+                  << "\tmovq $" << !first << ", %rsi" << endl;
+                G.strings.push_back(subc::Node(Child(p, 0)).string_value());
+                Gen_Runtime_Call(G, "subc_out_str");
+                prev_char = false;
+            } else {
+                bool is_char = Is_Char_Expr(G.P, f, Child(p, 0));
+                Gen_Expression(G, f, Child(p, 0));
+                o << "\tmovq %rax, %rdi" << endl
+                  << "\tmovq $" << (!first && !(prev_char && is_char)) << ", %rsi" << endl;
+                Gen_Runtime_Call(G, is_char ? "subc_out_char" : "subc_out_int");
+                prev_char = is_char;
+            }
+        }
+        Gen_Runtime_Call(G, "subc_out_end");
+    } else if (k == SUBC_IF) {
+        string else_label = New_Label(G), end_label = New_Label(G);
+        Gen_Expression(G, f, Child(s, 0));
+        o << "\ttestq %rax, %rax" << endl
+          << "\tje " << else_label << endl;
+        Gen_Statement(G, f, Child(s, 1));
+        o << "\tjmp " << end_label << endl
+          << else_label << ":" << endl;
+        if (s -> num_children == 3)
+            Gen_Statement(G, f, Child(s, 2));
+        o << end_label << ":" << endl;
+    } else if (k == SUBC_WHILE) {
+        string top_label = New_Label(G), end_label = New_Label(G);
+        o << top_label << ":" << endl;
+        Gen_Expression(G, f, Child(s, 0));
+        o << "\ttestq %rax, %rax" << endl
+          << "\tje " << end_label << endl;
+        Gen_Statement(G, f, Child(s, 1));
+        o << "\tjmp " << top_label << endl
+          << end_label << ":" << endl;
+    } else if (k == SUBC_REPEAT) {
+        string top_label = New_Label(G);
+        const TreeNode* cond = Child(s, s -> num_children - 1);
+        o << top_label << ":" << endl;
+        for (const TreeNode* p = s -> left.get(); p != cond; p = p -> right.get())
+            Gen_Statement(G, f, p);
+        Gen_Expression(G, f, cond);
+        o << "\ttestq %rax, %rax" << endl
+          << "\tje " << top_label << endl;
+    } else if (k == SUBC_FOR) {
+        string top_label = New_Label(G), end_label = New_Label(G);
+        Gen_Statement(G, f, Child(s, 0));
+        o << top_label << ":" << endl;
+        if (Child(s, 1) -> kind != SUBC_TRUE) {
+            Gen_Expression(G, f, Child(s, 1));
+            o << "\ttestq %rax, %rax" << endl
+              << "\tje " << end_label << endl;
+        }
+        Gen_Statement(G, f, Child(s, 3));
+        Gen_Statement(G, f, Child(s, 2));
+        o << "\tjmp " << top_label << endl
+          << end_label << ":" << endl;
+    } else if (k == SUBC_LOOP) {
+        string top_label = New_Label(G), end_label = New_Label(G);
+        G.exit_labels.push_back(end_label);
+        o << top_label << ":" << endl;
+        for (const TreeNode* p = s -> left.get(); p; p = p -> right.get())
+            Gen_Statement(G, f, p);
+        o << "\tjmp " << top_label << endl
+          << end_label << ":" << endl;
+        G.exit_labels.pop_back();
+    } else if (k == SUBC_CASE) {
+        Gen_Case(G, f, s);
+    } else if (k == SUBC_READ) {
+        for (const TreeNode* p = s -> left.get(); p; p = p -> right.get()) {
+            bool is_char = Lookup(G.P, f, Ident_Name(p)).is_char;
+            Gen_Runtime_Call(G, is_char ? "subc_read_char" : "subc_read_int");
+            o << "\tmovq %rax, " << Gen_Variable(G, f, Ident_Name(p)) << endl;
+        }
+    } else if (k == SUBC_EXIT) {
+        if (G.exit_labels.empty())
+            throw runtime_error("exit outside of a loop");
+        o << "\tjmp " << G.exit_labels.back() << endl;
+    } else if (k == SUBC_RETURN) {
+        Gen_Expression(G, f, Child(s, 0));
+        o << "\tjmp " << G.return_label << endl;
+    } else if (k != SUBC_NULL) {
+        throw runtime_error("Could not resolve statement " + s -> token.value + " in Gen_Statement()");
+    }
+}
+
+// Dense label sets dispatch through a table of label offsets, sparse ones
+// through a compare chain; either way the first matching clause wins.
+void Gen_Case(Gen_State& G, Function_Info* f, const TreeNode* s) {
+    struct Interval {
+        int64_t lo, hi;
+        string target;
+    };
+    ostream& o = G.o;
+    vector<Interval> intervals;
+    vector<const TreeNode*> clauses;
+    vector<string> clause_labels;
+    const TreeNode* otherwise = nullptr;
+    string end_label = New_Label(G), default_label = end_label;
+
+    for (const TreeNode* p = Child(s, 1); p; p = p -> right.get()) {
+        string target = New_Label(G);
+        if (p -> kind == SUBC_OTHERWISE) {
+            otherwise = p;
+            default_label = target;
+            continue;
+        }
+        for (int i = 0; i < p -> num_children - 1; ++i) {
+            const TreeNode* label = Child(p, i);
+            if (label -> kind == SUBC_RANGE)
+                intervals.push_back(Interval{Case_Label_Value(G.P, f, Child(label, 0)),
+                                             Case_Label_Value(G.P, f, Child(label, 1)), target});
+            else {
+                int64_t v = Case_Label_Value(G.P, f, label);
+                intervals.push_back(Interval{v, v, target});
+            }
+        }
+        clauses.push_back(Child(p, p -> num_children - 1));
+        clause_labels.push_back(target);
+    }
+
+    int64_t min = INT64_MAX, max = INT64_MIN;
+    uint64_t covered = 0;
+    for (const Interval& i : intervals) {
+        if (i.lo > i.hi)
+            continue;
+        min = i.lo < min ? i.lo : min;
+        max = i.hi > max ? i.hi : max;
+        covered += (uint64_t) i.hi - (uint64_t) i.lo + 1;
+    }
+    uint64_t span = (uint64_t) max - (uint64_t) min + 1;
+
+    Gen_Expression(G, f, Child(s, 0));
+    if (intervals.size() >= 4 && min <= max && span <= 1024 && covered * 2 >= span) {
+        string table_label = New_Label(G);
+        Gen_Immediate(G, "subq", min, "%rax");
+        o << "\tcmpq $" << span - 1 << ", %rax" << endl
+          << "\tja " << default_label << endl
+          << "\tleaq " << table_label << "(%rip), %rcx" << endl
+          << "\tmovslq (%rcx,%rax,4), %rdx" << endl
+          << "\taddq %rcx, %rdx" << endl
+          << "\tjmp *%rdx" << endl
+          << "\t.p2align 2" << endl
+          << table_label << ":" << endl;
+        for (uint64_t k = 0; k < span; ++k) {
+            int64_t v = (int64_t) ((uint64_t) min + k);
+            string target = default_label;
+            for (const Interval& i : intervals) {
+                if (v >= i.lo && v <= i.hi) {
+                    target = i.target;
+                    break;
+                }
+            }
+            o << "\t.long " << target << "-" << table_label << endl;
+        }
     } else {
-        Read(T_colon_equals_colon);
-        Name();
-        string s = "swap";
-        Build_Tree(s, 2);
-    }
-}
-
-void Expression() {
-    Term();
-    if (Next_Token == T_less_equals) {
-        Read(T_less_equals);
-        Term();
-        string s = "<=";
-        Build_Tree(s, 2);
-    } else if (Next_Token == T_less) {
-        Read(T_less);
-        Term();
-        string s = "<";
-        Build_Tree(s, 2);
-    } else if (Next_Token == T_greater) {
-        Read(T_greater);
-        Term();
-        string s = ">";
-        Build_Tree(s, 2);
-    } else if (Next_Token == T_greater_equals) {
-        Read(T_greater_equals);
-        Term();
-        string s = ">=";
-        Build_Tree(s, 2);
-    } else if (Next_Token == T_equals) {
-        Read(T_equals);
-        Term();
-        string s = "=";
-        Build_Tree(s, 2);
-    } else if (Next_Token == T_not_equals) {
-        Read(T_not_equals);
-        Term();
-        string s = "<>";
-        Build_Tree(s, 2);
-    }
-}
-
-void Term() {
-    Factor();
-    while (Next_Token == T_plus) {
-        Read(T_plus);
-        Factor();
-        string s = "+";
-        Build_Tree(s, 2);
-    }
-    while (Next_Token == T_minus) {
-        Read(T_minus);
-        Factor();
-        string s = "-";
-        Build_Tree(s, 2);
-    }
-    while (Next_Token == T_or) {
-        Read(T_or);
-        Factor();
-        string s = "or";
-        Build_Tree(s, 2);
-    }
-}
-
-void Factor() {
-    Primary();
-    while (Next_Token == T_star) {
-        Read(T_star);
-        Primary();
-        string s = "*";
-        Build_Tree(s, 2);
-    }
-    while (Next_Token == T_slash) {
-        Read(T_slash);
-        Primary();
-        string s = "/";
-        Build_Tree(s, 2);
-    }
-    while (Next_Token == T_and) {
-        Read(T_and);
-        Primary();
-        string s = "and";
-        Build_Tree(s, 2);
-    }
-    while (Next_Token == T_mod) {
-        Read(T_mod);
-        Primary();
-        string s = "mod";
-        Build_Tree(s, 2);
-    }
-}
-
-void Primary() {
-    int N = 1;
-    if (Next_Token.token_type == ID) {
-        Name();
-        if (Next_Token == T_open_parenthesis){
-            Read(T_open_parenthesis);
-            Expression();
-            while (Next_Token == T_comma) {
-                Read(T_comma);
-                Expression();
-                N++;
+        for (const Interval& i : intervals) {
+            if (i.lo == i.hi) {
+                Gen_Immediate(G, "cmpq", i.lo, "%rax");
+                o << "\tje " << i.target << endl;
+            } else {
+                string next_label = New_Label(G);
+                Gen_Immediate(G, "cmpq", i.lo, "%rax");
+                o << "\tjl " << next_label << endl;
+                Gen_Immediate(G, "cmpq", i.hi, "%rax");
+                o << "\tjle " << i.target << endl
+                  << next_label << ":" << endl;
             }
-            Read(T_close_parenthesis);
-            string s = "call";
-            Build_Tree(s, N+1);
-        }
-    } else if (Next_Token.token_type == INT) {
-        Read(Next_Token);
-    } else if (Next_Token.token_type == CHAR) {
-        Read(Next_Token);
+        }
+        o << "\tjmp " << default_label << endl;
+    }
+
+    for (size_t i = 0; i < clauses.size(); ++i) {
+        o << clause_labels[i] << ":" << endl;
+        Gen_Statement(G, f, clauses[i]);
+        o << "\tjmp " << end_label << endl;
+    }
+    if (otherwise) {
+        o << default_label << ":" << endl;
+        Gen_Statement(G, f, Child(otherwise, 0));
+    }
+    o << end_label << ":" << endl;
+}
+
+void Gen_Expression(Gen_State& G, Function_Info* f, const TreeNode* e) {
+    ostream& o = G.o;
+    subc_kind k = e -> kind;
+    if (k == SUBC_INTEGER || k == SUBC_CHAR) {
+        Gen_Immediate(G, "movq", Literal_Value(e), "%rax");
+    } else if (k == SUBC_IDENTIFIER) {
+        Symbol sym = Lookup(G.P, f, Ident_Name(e));
+        if (sym.kind == CONSTANT)
+            Gen_Immediate(G, "movq", sym.value, "%rax");
+        else
+            o << "\tmovq " << Gen_Variable(G, f, Ident_Name(e)) << ", %rax" << endl;
+    } else if (k == SUBC_CALL) {
+        Function_Info& callee = Lookup_Function(G.P, Ident_Name(Child(e, 0)), e -> num_children - 1);
+        for (const TreeNode* p = Child(e, 1); p; p = p -> right.get()) {
+            Gen_Expression(G, f, p);
+            o << "\tpushq %rax" << endl;
+        }
+        o << "\tcall F_" << callee.name << endl;
+        if (callee.num_params > 0)
+            o << "\taddq $" << 8 * callee.num_params << ", %rsp" << endl;
+    } else if (k == SUBC_EOF) {
+        Gen_Runtime_Call(G, "subc_eof");
+    } else if (k == SUBC_TRUE) {
+        o << "\tmovq $1, %rax" << endl;
+    } else if (e -> num_children == 1) {
+        Gen_Expression(G, f, Child(e, 0));
+        if (k == SUBC_MINUS)
+            o << "\tnegq %rax" << endl;
+        else if (k == SUBC_NOT)
+            o << "\ttestq %rax, %rax" << endl
+              << "\tsete %al" << endl
+              << "\tmovzbq %al, %rax" << endl;
+        else if (k == SUBC_SUCC)
+            o << "\tincq %rax" << endl;
+        else if (k == SUBC_PRED)
+            o << "\tdecq %rax" << endl;
+        else if (k != SUBC_CHR && k != SUBC_ORD)
+            throw runtime_error("Could not resolve unary operator " + e -> token.value + " in Gen_Expression()");
+    } else if (Is_Binary(e)) {
+        size_t base = G.spine.size();
+        for (; Is_Binary(e); e = Child(e, 0))
+            G.spine.push_back(e);
+        Gen_Expression(G, f, e);
+        while (G.spine.size() > base) {
+            const TreeNode* op = G.spine.back();
+            G.spine.pop_back();
+            o << "\tpushq %rax" << endl;
+            Gen_Expression(G, f, Child(op, 1));
+            o << "\tmovq %rax, %rcx" << endl
+              << "\tpopq %rax" << endl;
+            Gen_Binary(G, op);
+        }
     } else {
-        if (Next_Token == T_minus) {
-            Read(T_minus);
-            Primary();
-            string s = "-";
-            Build_Tree(s, 1);
-        } else if (Next_Token == T_plus) {
-            Read(T_plus);
-            Primary();
-        } else if (Next_Token == T_not) {
-            Read(T_not);
-            Primary();
-            string s = "not";
-            Build_Tree(s, 1);
-        } else if (Next_Token == T_eof) {
-            Read(T_eof);
-            string s = "eof";
-            Build_Tree(s, 0);
-        } else if (Next_Token == T_open_parenthesis) {
-            Read(T_open_parenthesis);
-            Expression();
-            Read(T_close_parenthesis);
-        } else if (Next_Token == T_succ) {
-            Read(T_succ);
-            Read(T_open_parenthesis);
-            Expression();
-            Read(T_close_parenthesis);
-            string s = "succ";
-            Build_Tree(s, 1);
-        } else if (Next_Token == T_pred) {
-            Read(T_pred);
-            Read(T_open_parenthesis);
-            Expression();
-            Read(T_close_parenthesis);
-            string s = "pred";
-            Build_Tree(s, 1);
-        } else if (Next_Token == T_chr) {
-            Read(T_chr);
-            Read(T_open_parenthesis);
-            Expression();
-            Read(T_close_parenthesis);
-            string s = "chr";
-            Build_Tree(s, 1);
-        } else if (Next_Token == T_ord){
-            Read(T_ord);
-            Read(T_open_parenthesis);
-            Expression();
-            Read(T_close_parenthesis);
-            string s = "ord";
-            Build_Tree(s, 1);
-        }
-    }
-}
-
-void OutExp() {
-    if (Next_Token.token_type == STRING) {
-        StringNode();
-        string s = "string";
-        Build_Tree(s, 1);
+        throw runtime_error("Could not resolve expression " + e -> token.value + " in Gen_Expression()");
+    }
+}
+
+// Emits the operator of a binary node, with its left operand in %rax and
+// its right one in %rcx.
+void Gen_Binary(Gen_State& G, const TreeNode* e) {
+    ostream& o = G.o;
+    subc_kind k = e -> kind;
+    if (k == SUBC_PLUS) {
+        o << "\taddq %rcx, %rax" << endl;
+    } else if (k == SUBC_MINUS) {
+        o << "\tsubq %rcx, %rax" << endl;
+    } else if (k == SUBC_TIMES) {
+        o << "\timulq %rcx, %rax" << endl;
+    } else if (k == SUBC_DIVIDE || k == SUBC_MOD) {
+        string nonzero_label = New_Label(G), divide_label = New_Label(G), end_label = New_Label(G);
+        o << "\ttestq %rcx, %rcx" << endl
+          << "\tjne " << nonzero_label << endl;
+        Gen_Runtime_Call(G, "subc_div_zero");
+        o << nonzero_label << ":" << endl
+          << "\tcmpq $-1, %rcx" << endl
+          << "\tjne " << divide_label << endl
+          << (k == SUBC_DIVIDE ? "\tnegq %rax" : "\txorl %eax, %eax") << endl
+          << "\tjmp " << end_label << endl
+          << divide_label << ":" << endl
+          << "\tcqto" << endl
+          << "\tidivq %rcx" << endl;
+        if (k == SUBC_MOD)
+            o << "\tmovq %rdx, %rax" << endl;
+        o << end_label << ":" << endl;
+    } else if (k == SUBC_AND || k == SUBC_OR) {
+        o << "\ttestq %rax, %rax" << endl
+          << "\tsetne %al" << endl
+          << "\ttestq %rcx, %rcx" << endl
+          << "\tsetne %cl" << endl
+          << (k == SUBC_AND ? "\tandb %cl, %al" : "\torb %cl, %al") << endl
+          << "\tmovzbq %al, %rax" << endl;
     } else {
-        Expression();
-        string s = "integer";
-        Build_Tree(s, 1);
+        string set;
+        if (k == SUBC_LT)
+            set = "setl";
+        else if (k == SUBC_LE)
+            set = "setle";
+        else if (k == SUBC_GT)
+            set = "setg";
+        else if (k == SUBC_GE)
+            set = "setge";
+        else if (k == SUBC_EQ)
+            set = "sete";
+        else if (k == SUBC_NE)
+            set = "setne";
+        else
+            throw runtime_error("Could not resolve binary operator " + e -> token.value + " in Gen_Expression()");
+        o << "\tcmpq %rcx, %rax" << endl
+          << "\t" << set << " %al" << endl
+          << "\tmovzbq %al, %rax" << endl;
     }
 }
 
-void StringNode() {
-    if (Next_Token.token_type == STRING)
-        Read(Next_Token);
-    else
-        throw runtime_error("Could not resolve Next_Token.token_type in StringNode()");
+
+
+
+/**************************** SERVER ****************************/
+
+// One request per connection over a Unix domain socket:
+//   request:  "<format> <kind> <length>\n" followed by <length> bytes, where
+//             format is ast, tokens, check or shutdown and kind is path or
+//             source (the program text itself)
+//   response: "ok <length>\n" or "error <length>\n" followed by <length> bytes
+// Connections are served by a fixed pool of Server_Threads workers; the
+// parser state is thread_local. Past Max_Pending_Connections accepted but
+// unserved, the server stops accepting and lets the listen backlog hold the
+// rest. A connection that sends or takes nothing for Connection_Timeout is
+// closed, so that stalled clients cannot hold every worker. Rendered
+// responses are cached, keyed on the source text or on the path with its
+// size and mtime, and shared by all connections. A shutdown request stops
+// the accepting; the server exits once the connections already accepted
+// are served.
+std::mutex Server_Mutex;        // guards Pending_Connections and Server_Stopping
+std::condition_variable Server_Changed;
+std::deque<int> Pending_Connections;
+bool Server_Stopping = false;
+int Server_Listener = -1;
+const size_t Max_Pending_Connections = 64;
+const unsigned Server_Threads = std::max(4u, std::thread::hardware_concurrency());
+const timeval Connection_Timeout = {10, 0};
+std::mutex Cache_Mutex;
+unordered_map<string, string> Response_Cache;
+size_t Response_Cache_Bytes = 0;
+const size_t Response_Cache_Limit = (size_t) 256 << 20;
+const size_t Max_Frame_Bytes = (size_t) 1 << 30;
+string Socket_Path;
+
+void Serve(const string& socket_path) {
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    sockaddr_un addr = sockaddr_un();
+    if (listener < 0 || socket_path.size() >= sizeof(addr.sun_path))
+        throw runtime_error("Failed to create socket " + socket_path);
+    // Bound under a temporary name and renamed once listening, so that a
+    // client that sees the socket can connect to it
+    string bound_path = socket_path + ".tmp";
+    if (bound_path.size() >= sizeof(addr.sun_path))
+        throw runtime_error("Failed to create socket " + socket_path);
+    addr.sun_family = AF_UNIX;
+    bound_path.copy(addr.sun_path, bound_path.size());
+    unlink(bound_path.c_str());
+    if (bind(listener, (sockaddr*) &addr, sizeof(addr)) < 0 || listen(listener, 64) < 0 ||
+        rename(bound_path.c_str(), socket_path.c_str()) < 0)
+        throw runtime_error("Failed to listen on socket " + socket_path);
+    signal(SIGPIPE, SIG_IGN);
+    Socket_Path = socket_path;
+    Server_Listener = listener;
+    vector<std::thread> workers;
+    for (unsigned t = 0; t < Server_Threads; ++t)
+        workers.push_back(std::thread(Serve_Worker));
+    while (true) {
+        {
+            std::unique_lock<std::mutex> hold(Server_Mutex);
+            Server_Changed.wait(hold, [] {
+                return Server_Stopping || Pending_Connections.size() < Max_Pending_Connections;
+            });
+            if (Server_Stopping)
+                break;
+        }
+        int fd = accept(listener, nullptr, nullptr);
+        if (fd < 0)
+            continue;
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &Connection_Timeout, sizeof(Connection_Timeout));
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &Connection_Timeout, sizeof(Connection_Timeout));
+        {
+            std::lock_guard<std::mutex> hold(Server_Mutex);
+            Pending_Connections.push_back(fd);
+        }
+        Server_Changed.notify_all();
+    }
+    for (std::thread& worker : workers)
+        worker.join();
+    close(listener);
 }
 
-void ForStat() {
-    if (Next_Token.token_type == ID)
-        Assignment();
-    else {
-        string s = "<null>";
-        Build_Tree(s, 0);
+void Serve_Worker() {
+    while (true) {
+        int fd;
+        {
+            std::unique_lock<std::mutex> hold(Server_Mutex);
+            Server_Changed.wait(hold, [] { return Server_Stopping || !Pending_Connections.empty(); });
+            if (Pending_Connections.empty())
+                return;
+            fd = Pending_Connections.front();
+            Pending_Connections.pop_front();
+        }
+        Server_Changed.notify_all();
+        Serve_Connection(fd);
     }
 }
 
-void ForExp() {
-    if (Next_Token.token_type == ID || Next_Token.token_type == CHAR || Next_Token.token_type == INT
-            || Next_Token == T_minus || Next_Token == T_plus || Next_Token == T_not
-            || Next_Token == T_eof || Next_Token == T_succ || Next_Token == T_pred
-            || Next_Token == T_chr || Next_Token == T_ord || Next_Token == T_open_parenthesis) {
-        Expression();
-    } else {
-        string s = "true";
-        Build_Tree(s, 0);
+void Serve_Connection(int fd) {
+    string header, payload;
+    try {
+        if (!Read_Frame(fd, header, payload)) {
+            close(fd);
+            return;
+        }
+    } catch (const std::exception& e) {
+        Write_Frame(fd, "error", e.what());
+        close(fd);
+        return;
+    }
+    std::istringstream fields(header);
+    string format, kind;
+    fields >> format >> kind;
+    if (format == "shutdown") {
+        Stop_Serving();
+        Write_Frame(fd, "ok", "");
+        close(fd);
+        return;
+    }
+
+    string key, response;
+    bool ok = true, hit = false;
+    try {
+        if (kind == "path") {
+            struct stat st;
+            if (stat(payload.c_str(), &st) != 0)
+                file_open_error();
+            key = format + " path " + payload + " " + std::to_string(st.st_size) + " " +
+                  std::to_string(st.st_mtim.tv_sec) + "." + std::to_string(st.st_mtim.tv_nsec);
+        } else if (kind == "source") {
+            key = format + " source " + payload;
+        } else {
+            throw runtime_error("Unknown request kind '" + kind + "'");
+        }
+        {
+            std::lock_guard<std::mutex> lock(Cache_Mutex);
+            auto it = Response_Cache.find(key);
+            if (it != Response_Cache.end()) {
+                response = it -> second;
+                hit = true;
+            }
+        }
+        if (!hit) {
+            if (kind == "path") {
+                ifstream inf(payload, std::ios::binary);
+                if (!inf)
+                    file_open_error();
+                std::stringstream buffer;
+                buffer << inf.rdbuf();
+                payload = buffer.str();
+            }
+            response = Render(format, payload.data(), payload.size());
+            std::lock_guard<std::mutex> lock(Cache_Mutex);
+            // Another connection may have rendered the same key meanwhile
+            auto it = Response_Cache.find(key);
+            if (it != Response_Cache.end())
+                Response_Cache_Bytes -= key.size() + it -> second.size();
+            if (Response_Cache_Bytes + key.size() + response.size() > Response_Cache_Limit) {
+                Response_Cache.clear();
+                Response_Cache_Bytes = 0;
+            }
+            Response_Cache[key] = response;
+            Response_Cache_Bytes += key.size() + response.size();
+        }
+    } catch (const std::exception& e) {
+        ok = false;
+        response = e.what();
     }
+    Write_Frame(fd, ok ? "ok" : "error", response);
+    close(fd);
 }
 
-void Caseclause() {
-    int N = 1;
-    CaseExpression();
-    while (Next_Token == T_comma) {
-        Read(T_comma);
-        CaseExpression();
-        N++;
+// Removes the socket, so that no client can connect once the shutdown is
+// answered, and wakes Serve() out of accept() to wait for the workers.
+void Stop_Serving() {
+    {
+        std::lock_guard<std::mutex> hold(Server_Mutex);
+        if (Server_Stopping)
+            return;
+        Server_Stopping = true;
     }
-    Read(T_colon);
-    Statement();
-    string s = "case_clause";
-    Build_Tree(s, N+1);
+    unlink(Socket_Path.c_str());
+    shutdown(Server_Listener, SHUT_RDWR);
+    Server_Changed.notify_all();
+}
+
+string Render(const string& format, const char* buf, size_t len) {
+    std::ostringstream o;
+    if (format == "tokens") {
+        for (const Token& t : Scan_All(buf, len, Parse_Threads))
+            o << Token_Type_Names[t.token_type] << " " << t.value << "\n";
+        return o.str();
+    }
+    if (format != "ast" && format != "check")
+        throw runtime_error("Unknown request format '" + format + "'");
+    subc::Ast ast = subc::parse(buf, len);
+    if (format == "ast")
+        PreOrderTreeTraversal(ast.root(), 0, o);
+    return o.str();
+}
+
+int Client(const string& socket_path, const string& format, const string& path) {
+    string kind = "path", payload = path;
+    if (format.empty() || format[0] != '-')
+        command_line_args_error();
+    if (path == "-") {
+        std::stringstream buffer;
+        buffer << std::cin.rdbuf();
+        kind = "source";
+        payload = buffer.str();
+    } else if (!path.empty() && path[0] != '/') {
+        char cwd[4096];
+        if (getcwd(cwd, sizeof(cwd)))
+            payload = string(cwd) + "/" + path;
+    }
+    int fd = Connect_Socket(socket_path);
+    string header, response;
+    if (!Write_Frame(fd, format.substr(1) + " " + kind, payload) || !Read_Frame(fd, header, response))
+        throw runtime_error("Lost connection to " + socket_path);
+    close(fd);
+    bool ok = header.compare(0, 3, "ok ") == 0;
+    fwrite(response.data(), 1, response.size(), ok ? stdout : stderr);
+    if (!ok)
+        fputc('\n', stderr);
+    return ok ? 0 : 1;
+}
+
+int Connect_Socket(const string& socket_path) {
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    sockaddr_un addr = sockaddr_un();
+    if (fd < 0 || socket_path.size() >= sizeof(addr.sun_path))
+        throw runtime_error("Failed to create socket " + socket_path);
+    addr.sun_family = AF_UNIX;
+    socket_path.copy(addr.sun_path, socket_path.size());
+    if (connect(fd, (sockaddr*) &addr, sizeof(addr)) < 0)
+        throw runtime_error("Failed to connect to " + socket_path);
+    return fd;
+}
+
+// Returns false if the connection closes before the whole frame is in.
+// Throws runtime_error for a header that does not end in a length, or whose
+// length is over Max_Frame_Bytes, since that comes from the other side.
+bool Read_Frame(int fd, string& header, string& payload) {
+    char ch = 0;
+    header.clear();
+    while (header.size() < 256) {
+        if (!Read_Full(fd, &ch, 1))
+            return false;
+        if (ch == '\n')
+            break;
+        header += ch;
+    }
+    size_t space = header.rfind(' ');
+    const char* digits = space == string::npos ? "" : header.c_str() + space + 1;
+    char* end;
+    errno = 0;
+    unsigned long long len = strtoull(digits, &end, 10);
+    if (ch != '\n' || !isdigit((unsigned char) *digits) || *end != '\0' || errno == ERANGE)
+        throw runtime_error("Malformed frame header '" + header.substr(0, 64) + "'");
+    if (len > Max_Frame_Bytes)
+        throw runtime_error("Frame of " + string(digits) + " bytes is over the limit of " +
+                            std::to_string(Max_Frame_Bytes));
+    payload.resize(len);
+    return len == 0 || Read_Full(fd, &payload[0], len);
+}
+
+bool Write_Frame(int fd, const string& header, const string& payload) {
+    string line = header + " " + std::to_string(payload.size()) + "\n";
+    return Write_Full(fd, line.data(), line.size()) && Write_Full(fd, payload.data(), payload.size());
 }
 
-void CaseExpression() {
-    ConstValue();
-    if (Next_Token == T_dotdot) {
-        Read(T_dotdot);
-        ConstValue();
-        string s = "..";
-        Build_Tree(s, 2);
+bool Read_Full(int fd, char* buf, size_t n) {
+    while (n > 0) {
+        ssize_t got = read(fd, buf, n);
+        if (got <= 0)
+            return false;
+        buf += got;
+        n -= got;
     }
+    return true;
 }
 
-void OtherwiseClause() {
-    if (Next_Token == T_otherwise) {
-        Read(T_otherwise);
-        Statement();
-        string s = "otherwise";
-        Build_Tree(s, 1);
-    } else if (Next_Token == T_semicolon) {
-        Read(T_semicolon);
+bool Write_Full(int fd, const char* buf, size_t n) {
+    while (n > 0) {
+        ssize_t put = write(fd, buf, n);
+        if (put <= 0)
+            return false;
+        buf += put;
+        n -= put;
     }
+    return true;
 }
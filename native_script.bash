@@ -0,0 +1,15 @@
+#!/bin/bash
+# Compiles every test program to x86-64 with 'p1 -S', runs it natively and
+# diffs its output against the interpreter ('p1 -run') on the same input.
+status=0
+for prog in tests/tiny_??; do
+    name=$(basename $prog)
+    input=/dev/null
+    if [ -f $prog.in ]; then input=$prog.in; fi
+    echo "Testing $name";
+    ./p1 -S $prog > out.s && gcc out.s runtime/subc_rt.c -o out.bin || { status=1; continue; }
+    ./out.bin < $input > native.out
+    ./p1 -run $prog < $input > interp.out
+    diff interp.out native.out || status=1
+done
+exit $status
@@ -0,0 +1,85 @@
+/*
+ * Runtime support for programs compiled with 'p1 -S'.
+ * Link with: gcc prog.s runtime/subc_rt.c -o prog
+ *
+ * Mirrors the I/O semantics of the interpreter ('p1 -run') exactly.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <ctype.h>
+
+static void subc_fail(const char* msg) {
+    fflush(stdout);
+    fprintf(stderr, "Runtime error: %s\n", msg);
+    exit(1);
+}
+
+static int skip_space(void) {
+    int ch;
+    do
+        ch = getchar();
+    while (ch != EOF && isspace(ch));
+    return ch;
+}
+
+long subc_eof(void) {
+    int ch = skip_space();
+    if (ch == EOF)
+        return 1;
+    ungetc(ch, stdin);
+    return 0;
+}
+
+long subc_read_int(void) {
+    int ch = skip_space();
+    int negative = 0;
+    unsigned long n = 0;
+    if (ch == EOF)
+        subc_fail("read past end of input");
+    if (ch == '-' || ch == '+') {
+        negative = ch == '-';
+        ch = getchar();
+    }
+    if (ch == EOF || !isdigit(ch))
+        subc_fail("invalid integer input");
+    while (ch != EOF && isdigit(ch)) {
+        n = n * 10 + (ch - '0');
+        ch = getchar();
+    }
+    if (ch != EOF)
+        ungetc(ch, stdin);
+    return (long) (negative ? 0 - n : n);
+}
+
+long subc_read_char(void) {
+    int ch = skip_space();
+    if (ch == EOF)
+        subc_fail("read past end of input");
+    return ch;
+}
+
+void subc_out_int(long v, long sep) {
+    if (sep)
+        putchar(' ');
+    printf("%ld", v);
+}
+
+void subc_out_char(long v, long sep) {
+    if (sep)
+        putchar(' ');
+    putchar((int) (unsigned char) v);
+}
+
+void subc_out_str(const char* s, long sep) {
+    if (sep)
+        putchar(' ');
+    fputs(s, stdout);
+}
+
+void subc_out_end(void) {
+    putchar('\n');
+}
+
+void subc_div_zero(void) {
+    subc_fail("division by zero");
+}
@@ -49,3 +49,159 @@ echo "Testing tiny_24";
 ./p1 -ast tests/tiny_24 > out.tree && diff tests/tiny_24.tree out.tree;
 echo "Testing tiny_25";
 ./p1 -ast tests/tiny_25 > out.tree && diff tests/tiny_25.tree out.tree;
+for t in tests/tiny_??; do
+    echo "Testing $(basename $t) with -j4";
+    ./p1 -ast -j4 $t > out.tree && diff $t.tree out.tree;
+done
+for t in tests/tiny_??; do
+    echo "Testing $(basename $t) tokens with -j4";
+    ./p1 -tokens $t > out.tree && ./p1 -tokens -j4 $t | diff out.tree -;
+done
+for t in tests/tiny_??; do
+    echo "Testing $(basename $t) streamed from stdin";
+    ./p1 -ast - < $t > out.tree && diff $t.tree out.tree;
+done
+for t in tests/tiny_??; do
+    echo "Testing $(basename $t) hash-consed";
+    ./p1 -ast -share $t > out.tree && diff $t.tree out.tree;
+done
+for t in tests/tiny_??; do
+    echo "Testing $(basename $t) kind index";
+    ./p1 -find call $t | wc -l | diff - <(grep -c "^\(\. \)*call(" $t.tree);
+    ./p1 -find '<identifier>' $t > out.tree && ./p1 -find '<identifier>' -j4 $t | diff out.tree -;
+done
+for t in tests/tiny_??; do
+    echo "Testing $(basename $t) with lazy bodies";
+    ./p1 -ast -lazy $t > out.tree && diff $t.tree out.tree;
+    ./p1 -sigs $t | wc -l | diff - <(grep -c "^\. \. fcn(" $t.tree);
+done
+for t in tests/tiny_??; do
+    echo "Testing $(basename $t) control flow";
+    ./p1 -lint $t > out.tree && ./p1 -cfg $t > out.tree || echo "-lint or -cfg failed";
+done
+echo "Testing lint warnings and control-flow graph sizes";
+printf "program a:\nvar g, unused: integer;\nfunction f(n: integer): integer;\nvar x, y, z: integer;\nbegin\nx := 1;\nx := n;\nif n > 0 then return (y);\nloop exit; output(x) pool;\nreturn (x);\nx := 2\nend f;\nbegin\ng := f(1);\noutput(g)\nend a.\n" > out.subc;
+./p1 -lint out.subc | diff - <(printf '%s\n' "out.subc:2:8: warning: 'unused' is declared but never used" \
+    "out.subc:4:11: warning: 'z' is declared but never used" "out.subc:6:1: warning: value assigned to 'x' is never used" \
+    "out.subc:8:15: warning: 'y' may be used before it is assigned" "out.subc:9:12: warning: unreachable code" \
+    "out.subc:11:1: warning: unreachable code");
+./p1 -cfg out.subc | head -2 | diff - <(printf '%s\n' \
+    "f: 10 blocks, 10 edges, 7 instructions, 4 variables, 5 definitions; liveness 2 passes, reaching definitions 2 passes" \
+    "a: 3 blocks, 2 edges, 2 instructions, 1 variables, 1 definitions; liveness 2 passes, reaching definitions 2 passes");
+rm -f out.subc;
+prev=""
+for t in tests/tiny_??; do
+    echo "Testing $(basename $t) structural diff";
+    ./p1 -astdiff $t $t | diff /dev/null -;
+    if [ -n "$prev" ]; then
+        ./p1 -astdiff $prev $t > out.tree;
+        status=$?;
+        cmp -s $prev.tree $t.tree;
+        [ $status = $? ] || echo "-astdiff $prev $t disagrees with their trees";
+    fi
+    prev=$t;
+done
+echo "Testing tiny_01 structural diff of one edit";
+sed 's/j:=j+1/j:=j+2/; s/^\tread(i);/\tread(i); output(i);/' tests/tiny_01 > out.subc;
+./p1 -astdiff tests/tiny_01 out.subc | diff - <(printf '%s\n' "~ fcn Factor 14:1 -> 14:1" \
+    "~ Factor: assign 19:23 -> 19:23" "+ factors: output 26:11");
+rm -f out.subc;
+echo "Testing integer and char literal decoding";
+printf "program a:\nbegin\noutput(9223372036854775807, 00012345678901234567, 'A', \"x y\")\nend a.\n" > out.subc;
+./p1 -run out.subc | diff - <(echo "9223372036854775807 12345678901234567 A x y");
+printf "program a:\nbegin\noutput(9223372036854775808)\nend a.\n" > out.subc;
+./p1 out.subc 2>&1 | grep -q "does not fit in 64 bits" || echo "integer overflow not reported";
+rm -f out.subc;
+echo "Testing constants naming local and global constants";
+printf "program a:\nconst g = 5;\nfunction f(n: integer): integer;\nconst k = g, j = k;\nbegin\nreturn (j + n)\nend f;\nbegin\noutput(f(1))\nend a.\n" > out.subc;
+./p1 -run out.subc | diff - <(echo "6");
+rm -f out.subc;
+echo "Testing the parse server";
+rm -f out.sock;
+./p1 -serve out.sock & server=$!;
+for i in $(seq 50); do [ -S out.sock ] && break; sleep 0.1; done;
+./p1 -client out.sock -ast tests/tiny_01 | diff tests/tiny_01.tree -;
+./p1 -client out.sock -tokens - < tests/tiny_02 | diff <(./p1 -tokens tests/tiny_02) -;
+printf "program a:\nbegin\noutput(1 2)\nend a.\n" | ./p1 -client out.sock -check - 2> out.tree && echo "-client -check accepted a bad program";
+grep -q "^3:10: " out.tree || echo "-client -check did not report the error";
+for request in 'ast path abc\n' 'ast source -5\n' 'ast source 99999999999999999999\n' 'ast source 4294967296\n' 'ast\n'; do
+    python3 -c "import socket, sys; s = socket.socket(socket.AF_UNIX); s.connect('out.sock'); s.sendall(sys.argv[1].encode().decode('unicode_escape').encode()); print(s.makefile('rb').readline().decode().split()[0])" "$request" |
+        grep -q "^error$" || echo "malformed header '$request' did not get an error";
+done;
+./p1 -client out.sock -ast tests/tiny_03 | diff tests/tiny_03.tree - || echo "the server did not survive malformed headers";
+python3 -c "
+import socket
+program = b'program a:\nbegin\noutput(1)\nend a.\n'
+conns = [socket.socket(socket.AF_UNIX) for i in range(300)]
+for c in conns:
+    c.connect('out.sock')
+    c.sendall(b'check source %d\n' % len(program) + program)
+print(sum(c.makefile('rb').readline() == b'ok 0\n' for c in conns))" | grep -q "^300$" || echo "the server dropped concurrent connections";
+python3 -c "
+import os, socket, subprocess
+program = open('tests/tiny_01', 'rb').read()
+c = socket.socket(socket.AF_UNIX)
+c.connect('out.sock')
+c.sendall(b'ast source %d\n' % len(program))
+subprocess.run(['./p1', '-client', 'out.sock', '-shutdown'], check=True)
+assert not os.path.exists('out.sock')
+c.sendall(program)
+os.write(1, c.makefile('rb').read())" | tail -n +2 | diff tests/tiny_01.tree - || echo "-shutdown dropped a request in flight";
+wait $server || echo "the server did not exit cleanly";
+rm -f out.sock;
+echo "Testing the C API of libsubc.so";
+make -s lib && gcc -std=c99 -Wall tests/capi_smoke.c -L. -lsubc -Wl,-rpath,. -o capi_smoke || echo "capi_smoke did not build";
+./capi_smoke tests/tiny_01 | diff tests/tiny_01.tree -;
+nm -DC --defined-only libsubc.so | grep "Build_Tree\|Parse_Source";
+echo "Testing subc::Visitor against -find";
+g++ -std=c++11 -Wall tests/visitor_smoke.cpp -L. -lsubc -Wl,-rpath,. -o visitor_smoke || echo "visitor_smoke did not build";
+{ printf "program a:\nfunction f(n: integer): integer;\nbegin\nreturn (n)\nend f;\nbegin\noutput(f(1)"; printf " + f(1)%.0s" $(seq 19999); printf ")\nend a.\n"; } > out.subc;
+for t in tests/tiny_?? out.subc; do
+    ./visitor_smoke $t | diff - <(echo "$(./p1 -find call $t | wc -l) $(./p1 -find fcn $t | wc -l)") || echo "Visitor and -find disagree on $t";
+done;
+rm -f out.subc;
+echo "Testing batch parsing with readahead";
+./p1 -batch tests/tiny_?? | grep -q "^25 files, [0-9]* bytes, 0 failed: .*(io_uring\|threads" || echo "-batch failed";
+./p1 -batch4 -threads tests/tiny_?? | grep -q "^25 files, [0-9]* bytes, 0 failed: .*(threads, 4 files ahead)" || echo "-batch -threads failed";
+ls tests/tiny_?? tests/tiny_01.tree | ./p1 -batch0 - > out.tree && echo "-batch accepted a .tree file";
+grep -q "^26 files, [0-9]* bytes, 1 failed" out.tree || echo "-batch did not count the failure";
+for mode in "" -threads; do
+    (ulimit -n 64; ./p1 -batch100000 $mode $(printf "tests/tiny_01 %.0s" $(seq 300))) |
+        grep -q "^300 files, [0-9]* bytes, 0 failed: .*, 32 files ahead)" || echo "-batch$mode ran out of descriptors";
+done;
+echo "Testing the per-production profiler";
+make -s p1-prof;
+./p1-prof -profile out.json tests/tiny_01 > out.tree || echo "-profile failed";
+grep -q "^Tiny  *1 " out.tree && grep -q "^program  *1$" out.tree || echo "-profile table is wrong";
+python3 -m json.tool out.json > /dev/null || echo "-profile trace is not JSON";
+rm -f out.json;
+for t in tests/tiny_??; do
+    echo "Testing $(basename $t) with the table-driven parser";
+    ./p1 -ast -ll1 $t > out.tree && diff $t.tree out.tree;
+    ./p1 -ll1 $t > out.tree || cat out.tree;
+done
+echo "Testing const lists and mixed operators with both parsers";
+printf "program a:\nconst c = 1, d = 2;\nvar x: integer;\nbegin\nx := c - d + 3 * 4 / 2 mod 5 and 1 or 0;\noutput(x)\nend a.\n" > out.subc;
+./p1 -ll1 out.subc | grep -q "^trees are equal" || echo "-ll1 failed on const lists and mixed operators";
+printf "program a:\nbegin\noutput(1 2)\nend a.\n" > out.subc;
+./p1 -ll1 out.subc > out.tree || echo "the parsers disagree on a program with an error";
+echo "Testing an operator chain longer than the nesting limit";
+{ printf "program a:\nbegin\noutput(1"; printf " + 1%.0s" $(seq 10000); printf ")\nend a.\n"; } > out.subc;
+./p1 -run out.subc | diff - <(echo "10001");
+./p1 -types out.subc || echo "-types failed on a long operator chain";
+./p1 -ll1 out.subc | grep -q "^trees are equal" || echo "-ll1 failed on a long operator chain";
+rm -f out.subc;
+for t in tests/tiny_??; do
+    echo "Testing $(basename $t) type check";
+    ./p1 -types $t > out.tree && grep "error:" out.tree;
+    ./p1 -types -j4 $t | diff out.tree -;
+done
+echo "Testing type errors";
+./p1 -types tests/tiny_04 | diff - <(echo "tests/tiny_04:29:35: error: the operand of '+' is Number, not integer");
+printf "program a:\ntype t = (r, g);\nvar x: integer; c: char; h: t;\nfunction f(n: integer): boolean;\nbegin\nreturn (n)\nend f;\nbegin\nif f(c) then h := 1;\nwhile x do x := x + f(1, 2);\ny := 0\nend a.\n" > out.subc;
+./p1 -types -j2 out.subc | diff - <(printf '%s\n' "out.subc:6:9: error: the value returned is integer, not boolean" \
+    "out.subc:9:6: error: argument 1 of 'f' is char, not integer" "out.subc:9:19: error: the value assigned to 'h' is integer, not t" \
+    "out.subc:10:7: error: the condition of 'while' is integer, not boolean" "out.subc:10:21: error: 'f' takes 1 arguments, not 2" \
+    "out.subc:10:21: error: the operand of '+' is boolean, not integer" \
+    "out.subc:11:1: warning: 'y' is not declared; it is taken to be an integer");
+rm -f out.subc;
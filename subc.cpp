@@ -0,0 +1,2069 @@
+#include "subc_internal.h"
+#include "subc_ll1.h"       // LL1_Predict, generated by ll1gen
+#include <unordered_set>    // unordered set
+#include <cstdio>           // fread
+#include <cstring>          // memchr
+#include <thread>           // thread
+#include <atomic>           // atomic
+#include <algorithm>        // min
+#ifdef SUBC_PROFILE
+#include <mutex>            // mutex
+#include <chrono>           // steady_clock
+#endif
+
+using std::isalpha;
+using std::isdigit;
+using std::isspace;
+using std::isalnum;
+using std::move;
+using std::runtime_error;
+using std::string;
+using std::unique_ptr;
+using std::unordered_set;
+using std::vector;
+using subc::detail::make_unique;
+
+
+
+/**************************** GLOBALS ****************************/
+char Stream_Buffer[1 << 16];
+unsigned Parse_Threads = 1;
+string Source_Name;
+// When set, SubProgs() hands each function to it as soon as it is parsed
+// instead of keeping it, and subprogs gets no children of its own.
+void (*Function_Parsed)(unique_ptr<TreeNode> fcn) = nullptr;
+// When set, Read() and Build_Tree() intern nodes in this pool and push them
+// onto Shared_Stack instead of building a TreeNode on S.
+thread_local Node_Pool* Shared_Pool = nullptr;
+thread_local vector<const Shared_Node*> Shared_Stack;
+// When set, Read() and Build_Tree() add every node they build to it.
+thread_local Node_Index* Kind_Index = nullptr;
+// When set, Fcn() skips each body with Skip_Body() instead of parsing it.
+thread_local bool Lazy_Bodies = false;
+// Levels of nesting the parser is in; see Nesting_Level.
+thread_local int Nesting = 0;
+const int Max_Nesting = 10000;
+const size_t Max_Source_Bytes = UINT32_MAX;
+thread_local Source src;
+thread_local vector<uint32_t> Line_Index;
+thread_local char c;
+thread_local Token Next_Token;
+thread_local std::stack<unique_ptr<TreeNode>> S;
+#ifdef SUBC_PROFILE
+// Every thread's profile, and the names of the rules they count; see
+// Register_Rule() and Profile_Here().
+std::mutex Profile_Lock;
+vector<string> Rule_Names;
+vector<unique_ptr<Thread_Profile>> Profiles;
+thread_local Thread_Profile* Profile_Current = nullptr;
+bool Profile_Trace = false;
+extern const size_t Max_Trace_Events = 1 << 20;   // per thread
+std::chrono::steady_clock::time_point Profile_Epoch = std::chrono::steady_clock::now();
+#endif
+unordered_set<string> keywords =
+        {
+                "program", "var", "const", "type", "function",  "return", "begin",
+                "end", "output", "if",  "then", "else", "while", "do",
+                "case", "of", "otherwise", "repeat", "for", "until",  "loop",
+                "pool", "exit", "mod", "and", "or", "not", "read",
+                "succ", "pred", "chr", "ord", "eof"
+        };
+const char* Token_Type_Names[] =
+        {
+                "KEYWORD", "ID", "INT", "CHAR", "STRING", "COMMENT", "DONT_CARE", "END_TOKEN"
+        };
+// Labels of the subc_kind values, in order; SUBC_TEXT has none of its own.
+const char* Kind_Names[] =
+        {
+                "program", "consts", "const", "types", "type", "lit",
+                "dclns", "var", "subprogs", "fcn", "params", "block",
+                "output", "if", "while", "repeat", "for", "loop",
+                "case", "read", "exit", "return", "<null>", "assign",
+                "swap", "case_clause", "..", "otherwise", "string",
+                "integer", "true", "<=", "<", ">", ">=", "=",
+                "<>", "+", "-", "or", "*", "/", "and",
+                "mod", "not", "eof", "succ", "pred", "chr", "ord",
+                "call", "<identifier>", "<integer>", "<char>", "<string>", "<body>", ""
+        };
+const Token T_program = Token{KEYWORD, "program"},
+        T_const = Token{KEYWORD, "const"},
+        T_type = Token{KEYWORD, "type"},
+        T_var = Token{KEYWORD, "var"},
+        T_function = Token{KEYWORD, "function"},
+        T_begin = Token{KEYWORD, "begin"},
+        T_end = Token{KEYWORD, "end"},
+        T_output = Token{KEYWORD, "output"},
+        T_or = Token{KEYWORD, "or"},
+        T_and = Token{KEYWORD, "and"},
+        T_mod = Token{KEYWORD, "mod"},
+        T_not = Token{KEYWORD, "not"},
+        T_eof = Token{KEYWORD, "eof"},
+        T_succ = Token{KEYWORD, "succ"},
+        T_pred = Token{KEYWORD, "pred"},
+        T_chr = Token{KEYWORD, "chr"},
+        T_ord = Token{KEYWORD, "ord"},
+        T_if = Token{KEYWORD, "if"},
+        T_else = Token{KEYWORD, "else"},
+        T_then = Token{KEYWORD, "then"},
+        T_while = Token{KEYWORD, "while"},
+        T_do = Token{KEYWORD, "do"},
+        T_until = Token{KEYWORD, "until"},
+        T_repeat = Token{KEYWORD, "repeat"},
+        T_for = Token{KEYWORD, "for"},
+        T_loop = Token{KEYWORD, "loop"},
+        T_pool = Token{KEYWORD, "pool"},
+        T_otherwise = Token{KEYWORD, "otherwise"},
+        T_of = Token{KEYWORD, "of"},
+        T_case = Token{KEYWORD, "case"},
+        T_read = Token{KEYWORD, "read"},
+        T_exit = Token{KEYWORD, "exit"},
+        T_return = Token{KEYWORD, "return"},
+        T_colon = Token{DONT_CARE, ":"},
+        T_equals = Token{DONT_CARE, "="},
+        T_comma = Token{DONT_CARE, ","},
+        T_semicolon = Token{DONT_CARE, ";"},
+        T_open_parenthesis = Token{DONT_CARE, "("},
+        T_close_parenthesis = Token{DONT_CARE, ")"},
+        T_colon_equals = Token{DONT_CARE, ":="},
+        T_colon_equals_colon = Token{DONT_CARE, ":=:"},
+        T_less_equals = Token{DONT_CARE, "<="},
+        T_less = Token{DONT_CARE, "<"},
+        T_greater = Token{DONT_CARE, ">"},
+        T_greater_equals = Token{DONT_CARE, ">="},
+        T_not_equals = Token{DONT_CARE, "<>"},
+        T_plus = Token{DONT_CARE, "+"},
+        T_minus = Token{DONT_CARE, "-"},
+        T_star = Token{DONT_CARE, "*"},
+        T_slash = Token{DONT_CARE, "/"},
+        T_dotdot = Token{DONT_CARE, ".."},
+        T_dot = Token{DONT_CARE, "."};
+
+
+/**************************** SCANNER ****************************/
+
+// Offsets are kept in 32 bits, so a longer source is refused up front
+// rather than being given offsets that wrap.
+void Check_Source_Size(size_t len) {
+    if (len > Max_Source_Bytes)
+        throw runtime_error("Source of " + std::to_string(len) + " bytes is over the limit of " +
+                            std::to_string(Max_Source_Bytes) + " bytes.");
+}
+
+void Set_Source(const char* begin, size_t from, size_t to) {
+    Check_Source_Size(to);
+    src = Source{begin, begin + from, begin + to, true, nullptr, 0};
+    Line_Index.clear();
+}
+
+// Reads stdin through a fixed buffer that is reused from the start each
+// time the scanner drains it; the scanner keeps no pointers into it.
+void Set_Stream_Source() {
+    src = Source{Stream_Buffer, Stream_Buffer, Stream_Buffer, true, Refill_From_Stdin, 0};
+}
+
+bool Refill_From_Stdin() {
+    src.base += src.end - src.begin;
+    size_t n = fread(Stream_Buffer, 1, sizeof(Stream_Buffer), stdin);
+    Check_Source_Size(src.base + n);
+    src.next = Stream_Buffer;
+    src.end = Stream_Buffer + n;
+    return n > 0;
+}
+
+// Same contract as istream::get(char&): 'c' is left alone past the end.
+inline void Get_Char() {
+    if (src.next != src.end || (src.refill && src.refill()))
+        c = *src.next++;
+    else
+        src.good = false;
+}
+
+// Offset of 'c' in the source, valid while src.good.
+inline uint32_t Char_Offset() {
+    return (uint32_t) (src.base + (src.next - src.begin) - 1);
+}
+
+// "line:column" of a source offset. The line index is only built the first
+// time a location is needed, so scanning never counts lines.
+string Location(uint32_t offset) {
+    if (src.refill)
+        return "byte " + std::to_string(offset);
+    if (Line_Index.empty()) {
+        const char* text = src.begin;
+        size_t len = src.end - src.begin;
+        Line_Index.push_back(0);
+        for (const char* p = text; (p = (const char*) memchr(p, '\n', text + len - p)); ++p)
+            Line_Index.push_back((uint32_t) (p - text + 1));
+    }
+    size_t line = std::upper_bound(Line_Index.begin(), Line_Index.end(), offset) - Line_Index.begin();
+    return std::to_string(line) + ":" + std::to_string(offset - Line_Index[line - 1] + 1);
+}
+
+string Diagnostic(uint32_t offset, const string& msg) {
+    return (Source_Name.empty() ? "" : Source_Name + ":") + Location(offset) + ": " + msg;
+}
+
+Token Scan() {
+    Token t = Scan_Token();
+    PROFILE_TOKEN();
+
+    // Ignore Comment
+    while (t.token_type == COMMENT)
+        t = Scan_Token();
+
+    // Edge case: Last char in file is space. So reading this causes t to be empty.
+    if (t.value.empty()) {
+        t.token_type = END_TOKEN;
+        t.offset = (uint32_t) (src.base + (src.next - src.begin));
+    }
+
+    return t;
+}
+
+Token Scan_Token() {
+    Token t = Token();
+    State S = START;
+    while (S != FINAL) {
+        if (!src.good) {
+            // Input ran out mid-token: end it as a newline would, unless it
+            // is a comment or literal still waiting for its closing character
+            if (S == START)
+                break;
+            if (S == OPEN_CURLY_BRACKET)
+                throw runtime_error(Diagnostic(t.offset, "Comment is not closed by '}'."));
+            if (S == OPEN_SINGLE_QUOTE || S == OPEN_DOUBLE_QUOTE)
+                throw runtime_error(Diagnostic(t.offset, "Literal is not closed by " +
+                                               string(S == OPEN_SINGLE_QUOTE ? "'" : "\"") + "."));
+            c = '\n';
+        }
+        switch (S) {
+            case START:
+                Handle_Start_State(S, t);
+                break;
+            case IDENTIFIER:
+                Handle_Identifier_State(S, t);
+                break;
+            case OPEN_CURLY_BRACKET:
+                Handle_Open_Curly_Bracket_State(S, t);
+                break;
+            case COLON:
+                Handle_Colon_State(S, t);
+                break;
+            case COLON_EQUALS:
+                Handle_Colon_Equals_State(S, t);
+                break;
+            case OPEN_ANGLE_BRACKET:
+                Handle_Open_Angle_Bracket_State(S, t);
+                break;
+            case CLOSE_ANGLE_BRACKET:
+                Handle_Close_Angle_Bracket_State(S, t);
+                break;
+            case INTEGER:
+                Handle_Integer_State(S, t);
+                break;
+            case DOT:
+                Handle_Dot_State(S, t);
+                break;
+            case OCTOTHORPE:
+                Handle_Octothorpe_State(S, t);
+                break;
+            case OPEN_SINGLE_QUOTE:
+                Handle_Open_Single_Quote_State(S, t);
+                break;
+            case OPEN_DOUBLE_QUOTE:
+                Handle_Open_Double_Quote_State(S, t);
+                break;
+            default:
+                throw runtime_error("Could not resolve state S");
+                break;
+        }
+    }
+    return t;
+}
+
+// Lexes tokens starting in [from, stop); the last one may run past 'stop'.
+// A speculative run records errors instead of throwing, and stops early
+// once it reaches a token start that 'converge' also has.
+Lex_Run Lex_Range(const char* begin, size_t len, size_t from, size_t stop, bool speculative,
+                  const Lex_Run* converge) {
+    Lex_Run run = Lex_Run{{}, len, false, false};
+    Set_Source(begin, from, len);
+    Get_Char();
+    while (true) {
+        while (src.good && isspace(c))
+            Get_Char();
+        size_t offset = src.good ? src.next - 1 - begin : len;
+        if (offset >= stop) {
+            run.exit = offset;
+            break;
+        }
+        if (converge && Find_Offset(*converge, offset) >= 0) {
+            run.exit = offset;
+            run.converged = true;
+            break;
+        }
+        try {
+            run.tokens.push_back(Lexed_Token{offset, Scan_Token()});
+        } catch (const std::exception&) {
+            if (!speculative)
+                throw;
+            run.exit = offset;
+            run.failed = true;
+            break;
+        }
+    }
+    return run;
+}
+
+// Index of the token starting at 'offset' in 'run', the size of the run if
+// 'offset' is its exit, or -1.
+long Find_Offset(const Lex_Run& run, size_t offset) {
+    if (offset == run.exit && !run.failed)
+        return (long) run.tokens.size();
+    size_t lo = 0, hi = run.tokens.size();
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if (run.tokens[mid].offset < offset)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo < run.tokens.size() && run.tokens[lo].offset == offset ? (long) lo : -1;
+}
+
+// Tokenizes the whole buffer the way repeated Scan() calls would, ending
+// with END_TOKEN. With more than one thread the buffer is cut into chunks
+// that are lexed speculatively: first from the chunk start as if it began
+// between tokens, then from just past the next '}', newline, quote or
+// double quote, in case it began inside a comment or literal. Those runs
+// stop as soon as they meet a token start of the first one. Chunks are then
+// stitched in order: each continues from whichever run has a token where
+// the previous chunk's last token ended, or is lexed again if none does.
+vector<Token> Scan_All(const char* begin, size_t len, unsigned threads) {
+    Check_Source_Size(len);     // before any thread lexes it
+    const size_t min_chunk = 1024;
+    const char closers[] = {'}', '\n', '\'', '\"'};
+    const int contexts = 1 + sizeof(closers);
+    size_t chunks = threads > 1 ? std::min<size_t>(threads * 4, len / min_chunk) : 1;
+    chunks = chunks ? chunks : 1;
+    vector<size_t> bounds;
+    for (size_t j = 0; j <= chunks; ++j)
+        bounds.push_back(len / chunks * j + (j == chunks ? len % chunks : 0));
+
+    vector<Lex_Run> runs(chunks * contexts, Lex_Run{{}, len, true, false});
+    auto lex_phase = [&](bool first) {
+        std::atomic<size_t> next_task(0);
+        auto worker = [&]() {
+            for (size_t task = next_task++; task < chunks * contexts; task = next_task++) {
+                size_t j = task / contexts;
+                int k = (int) (task % contexts);
+                if ((k == 0) != first || (j == 0 && k != 0))
+                    continue;
+                size_t from = bounds[j];
+                if (k != 0) {
+                    const char* close = (const char*) memchr(begin + from, closers[k - 1], len - from);
+                    if (!close)
+                        continue;
+                    from = close - begin + (closers[k - 1] == '\n' ? 0 : 1);
+                }
+                runs[task] = Lex_Range(begin, len, from, bounds[j + 1], true, k ? &runs[j * contexts] : nullptr);
+            }
+        };
+        vector<std::thread> pool;
+        for (unsigned t = 1; t < threads; ++t)
+            pool.push_back(std::thread(worker));
+        worker();
+        for (std::thread& t : pool)
+            t.join();
+    };
+    lex_phase(true);
+    if (chunks > 1)
+        lex_phase(false);
+
+    vector<Token> tokens;
+    size_t offset = 0;
+    for (size_t j = 0; j < chunks; ++j) {
+        if (offset >= bounds[j + 1])
+            continue;
+        Lex_Run* run = nullptr;
+        Lex_Run again;
+        long index = -1;
+        for (int k = 0; k < contexts && index < 0; ++k) {
+            run = &runs[j * contexts + k];
+            index = Find_Offset(*run, offset);
+        }
+        while (true) {
+            if (index < 0) {
+                // No run agrees with the real stream here (or one hit an
+                // error it has to report), so lex it for real
+                again = Lex_Range(begin, len, offset, bounds[j + 1], false, nullptr);
+                run = &again;
+                index = 0;
+            }
+            for (size_t i = index; i < run -> tokens.size(); ++i)
+                if (run -> tokens[i].token.token_type != COMMENT)
+                    tokens.push_back(move(run -> tokens[i].token));
+            offset = run -> exit;
+            if (run -> failed)
+                index = -1;
+            else if (run -> converged)
+                run = &runs[j * contexts], index = Find_Offset(*run, offset);
+            else
+                break;
+        }
+    }
+    tokens.push_back(Token{END_TOKEN, ""});
+    return tokens;
+}
+
+void Handle_Start_State(State& S, Token& t) {
+    if (c == '_' || isalpha(c))
+        S = IDENTIFIER;
+    else if (c == '{')
+        S = OPEN_CURLY_BRACKET;
+    else if (c == ':')
+        S = COLON;
+    else if (c == ';' || c == '(' ||c == ')' ||c == '+' ||c == '-' || c == '*' ||
+             c == '/' || c == '=' || c == ',') {
+        S = FINAL;
+        t.token_type = DONT_CARE;
+    }
+    else if (c == '<')
+        S = OPEN_ANGLE_BRACKET;
+    else if (c == '>')
+        S = CLOSE_ANGLE_BRACKET;
+    else if (isdigit(c))
+        S = INTEGER;
+    else if (c == '.')
+        S = DOT;
+    else if (c == '#')
+        S = OCTOTHORPE;
+    else if (c == '\'')
+        S = OPEN_SINGLE_QUOTE;
+    else if (c == '\"')
+        S = OPEN_DOUBLE_QUOTE;
+    else if (isspace(c))
+        {}
+    else
+        throw runtime_error(Diagnostic(Char_Offset(), "Unexpected character '" + string(1, c) + "'"));
+
+    if (!isspace(c)) {
+        t.offset = Char_Offset();
+        t.value += c;
+    }
+    Get_Char();
+}
+
+void Handle_Identifier_State(State& S, Token& t) {
+    if (c == '_' || isalnum(c)) {
+        S = IDENTIFIER;
+        t.value += c;
+        Get_Char();
+    } else {
+        if (keywords.find(t.value) != keywords.end())
+            t.token_type = KEYWORD;
+        else
+            t.token_type = ID;
+        S = FINAL;
+    }
+}
+
+// Comments are dropped by Scan(), so their text is not kept: the token
+// holds just the '{' or '#' that opened it, however long it runs.
+void Handle_Open_Curly_Bracket_State(State& S, Token& t) {
+    if (c != '}')
+        S = OPEN_CURLY_BRACKET;
+    else {
+        t.token_type = COMMENT;
+        S = FINAL;
+    }
+    Get_Char();
+}
+
+void Handle_Colon_State(State& S, Token& t) {
+    if (c == '=') {
+        S = COLON_EQUALS;
+        t.value += c;
+        Get_Char();
+    } else {
+        t.token_type = DONT_CARE;
+        S = FINAL;          // Must take empty to final state
+    }
+}
+
+void Handle_Colon_Equals_State(State& S, Token& t) {
+    if (c == ':') {
+        t.token_type = DONT_CARE;
+        S = FINAL;
+        t.value += c;
+        Get_Char();
+    } else {
+        t.token_type = DONT_CARE;
+        S = FINAL;          // Must take empty to final state
+    }
+}
+
+void Handle_Open_Angle_Bracket_State(State& S, Token& t){
+    if (c == '>' || c == '=') {
+        t.token_type = DONT_CARE;
+        S = FINAL;
+        t.value += c;
+        Get_Char();
+    } else {
+        t.token_type = DONT_CARE;
+        S = FINAL;          // Must take empty to final state
+    }
+}
+
+void Handle_Close_Angle_Bracket_State(State& S, Token& t){
+    if (c == '=') {
+        t.token_type = DONT_CARE;
+        S = FINAL;
+        t.value += c;
+        Get_Char();
+    } else {
+        t.token_type = DONT_CARE;
+        S = FINAL;          // Must take empty to final state
+    }
+}
+
+void Handle_Integer_State(State& S, Token& t) {
+    if (isdigit(c)) {
+        S = INTEGER;
+        t.value += c;
+        Get_Char();
+    } else {
+        t.token_type= INT;
+        t.number = Decode_Integer(t.value, t.offset);
+        S = FINAL;          // Must take empty to final state
+    }
+}
+
+// Value of a run of decimal digits, converted eight at a time. A value past
+// INT64_MAX is rejected, since no variable could hold it.
+int64_t Decode_Integer(const string& digits, uint32_t offset) {
+    size_t first = digits.find_first_not_of('0');
+    if (first == string::npos)
+        return 0;
+    size_t len = digits.size() - first;
+    const char* p = digits.data() + first;
+    uint64_t n = 0;         // 19 digits cannot overflow 64 unsigned bits
+    if (len <= 19) {
+        size_t head = len % 8;
+        for (size_t i = 0; i < head; ++i)
+            n = n * 10 + (p[i] - '0');
+        for (size_t i = head; i < len; i += 8)
+            n = n * 100000000 + Eight_Digits(p + i);
+    }
+    if (len > 19 || n > (uint64_t) INT64_MAX)
+        throw runtime_error(Diagnostic(offset, "Integer literal " + (digits.size() > 24 ? digits.substr(0, 20) + "..." : digits) +
+                                       " does not fit in 64 bits."));
+    return (int64_t) n;
+}
+
+// Eight ASCII digits as a number, in one 64-bit word: after subtracting
+// '0' from every byte, one multiply joins neighbouring digits into pairs
+// and two more join the pairs into the result.
+inline uint32_t Eight_Digits(const char* p) {
+    uint64_t w;
+    memcpy(&w, p, 8);
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    w = __builtin_bswap64(w);   // first digit in the low byte
+#endif
+    w -= 0x3030303030303030ull;
+    w = w * 10 + (w >> 8);
+    w = (((w & 0x000000FF000000FFull) * 0x000F424000000064ull) +
+         (((w >> 16) & 0x000000FF000000FFull) * 0x0000271000000001ull)) >> 32;
+    return (uint32_t) w;
+}
+
+void Handle_Dot_State(State& S, Token& t) {
+    if (c == '.') {
+        t.token_type = DONT_CARE;
+        S = FINAL;
+        t.value += c;
+        Get_Char();
+    } else {
+        t.token_type = DONT_CARE;
+        S = FINAL;          // Must take empty to final state
+    }
+}
+
+void Handle_Octothorpe_State(State& S, Token& t) {
+    if (c != '\n') {
+        S = OCTOTHORPE;
+        Get_Char();
+    } else {
+        t.token_type = COMMENT;
+        S = FINAL;          // Must take empty to final state
+    }
+}
+
+void Handle_Open_Single_Quote_State(State& S, Token& t) {
+    if (c != '\'') {
+        S = OPEN_SINGLE_QUOTE;
+    } else {
+        if (t.value.size() != 2)
+            throw runtime_error(Diagnostic(t.offset, "A char literal holds exactly one character."));
+        t.token_type = CHAR;
+        t.number = (unsigned char) t.value[1];
+        S = FINAL;
+    }
+    t.value += c;
+    Get_Char();
+}
+
+void Handle_Open_Double_Quote_State(State& S, Token& t) {
+    if (c != '\"') {
+        S = OPEN_DOUBLE_QUOTE;
+    } else {
+        t.token_type = STRING;
+        S = FINAL;
+    }
+    t.value += c;
+    Get_Char();
+}
+
+
+/**************************** PARSER ****************************/
+
+// Frees the subtree and the following siblings without recursing: a block
+// of a million statements is a sibling chain that long, and 1 + 1 + ...
+// a left-deep tree as deep.
+subc_node_impl::~subc_node_impl() {
+    vector<unique_ptr<TreeNode>> pending;
+    if (left)
+        pending.push_back(move(left));
+    if (right)
+        pending.push_back(move(right));
+    while (!pending.empty()) {
+        unique_ptr<TreeNode> n = move(pending.back());
+        pending.pop_back();
+        if (n -> left)
+            pending.push_back(move(n -> left));
+        if (n -> right)
+            pending.push_back(move(n -> right));
+    }
+}
+
+// Counts levels of nesting for as long as it lives: one per nested
+// statement or primary, the productions that recurse. Past Max_Nesting the
+// program is rejected, so the parser cannot run out of stack, whatever the
+// input. A chain like 1 + 1 + ... is parsed by a loop and is not nesting,
+// however long; the passes over its left-deep tree walk it without
+// recursing.
+struct Nesting_Level {
+    int levels;
+    Nesting_Level() : levels(0) {}
+    ~Nesting_Level() { Nesting -= levels; }
+    void add() {
+        levels++;
+        if (++Nesting > Max_Nesting)
+            throw runtime_error(Diagnostic(Next_Token.offset, "Program is nested more than " +
+                                           std::to_string(Max_Nesting) + " levels deep."));
+    }
+};
+
+void Read(const Token& t) {
+    if (t != Next_Token)
+        throw runtime_error(Diagnostic(Next_Token.offset, "Token did not match expected value: expected '" +
+                                       t.value + "' but found '" + Next_Token.value + "'."));
+
+    if (t.token_type != KEYWORD && t.token_type != DONT_CARE) {
+        subc_kind kind;
+        if (t.token_type == ID)
+            kind = SUBC_IDENTIFIER;
+        else if (t.token_type == INT)
+            kind = SUBC_INTEGER;
+        else if (t.token_type == CHAR)
+            kind = SUBC_CHAR;
+        else if (t.token_type == STRING)
+            kind = SUBC_STRING;
+        else
+            throw runtime_error("Unresolved Token_Type in Read()");
+
+        if (Shared_Pool) {
+            const Shared_Node* text = Intern(t.value, t.offset, nullptr, 0);
+            Shared_Stack.push_back(Intern(Kind_Names[kind], t.offset, &text, 1));
+        } else {
+            unique_ptr<TreeNode> N = make_unique<TreeNode>(TreeNode{1, kind, Token{DONT_CARE, Kind_Names[kind], t.offset}, nullptr, nullptr});
+            N -> left = make_unique<TreeNode>(TreeNode{0, SUBC_TEXT, Token{DONT_CARE, t.value, t.offset}, nullptr, nullptr});
+            N -> token.number = N -> left -> token.number = t.number;
+            N -> left -> hash = Hash_Node(N -> left.get());
+            N -> hash = Hash_Node(N.get());
+            if (Kind_Index)
+                Index_Node(N.get());
+            S.push(move(N));
+        }
+    }
+    Next_Token = Scan();
+}
+
+// 'offset' is where the construct starts; by default its first child's
+// offset, or the next token's for an empty construct.
+void Build_Tree(subc_kind kind, int n, int64_t offset){
+    PROFILE_BUILD(kind);
+    if (Shared_Pool) {
+        const Shared_Node** children = Shared_Stack.data() + Shared_Stack.size() - n;
+        if (offset < 0)
+            offset = n > 0 ? children[0] -> offset : Next_Token.offset;
+        const Shared_Node* N = Intern(Kind_Names[kind], (uint32_t) offset, children, n);
+        Shared_Stack.resize(Shared_Stack.size() - n);
+        Shared_Stack.push_back(N);
+        return;
+    }
+    unique_ptr<TreeNode> p;
+    unique_ptr<TreeNode> c;
+    for (int i = 1; i <= n; ++i) {
+        c = move(S.top());
+        S.pop();
+        c -> right = move(p);
+        p = move(c);
+    }
+    if (offset < 0)
+        offset = p ? p -> token.offset : Next_Token.offset;
+    unique_ptr<TreeNode> N = make_unique<TreeNode>(TreeNode{n, kind, Token{KEYWORD, Kind_Names[kind], (uint32_t) offset}, nullptr, nullptr});
+    N -> left = move(p);
+    N -> hash = Hash_Node(N.get());
+    if (Kind_Index)
+        Index_Node(N.get());
+    S.push(move(N));
+    p.release();
+    c.release();
+    N.release();
+}
+
+// Merkle hash of a node: its kind, its text if it is a leaf, and its
+// children's hashes in order, which must already be set. Offsets are left
+// out, so equal subtrees hash equal wherever they sit in either source.
+uint64_t Hash_Node(const TreeNode* n) {
+    uint64_t h = 0xCBF29CE484222325ull ^ (uint64_t) n -> kind;
+    if (!n -> left)
+        h = Hash_Bytes(h, n -> token.value.data(), n -> token.value.size());
+    for (const TreeNode* c = n -> left.get(); c; c = c -> right.get())
+        h = Mix_Hash(h ^ c -> hash);
+    return Mix_Hash(h);
+}
+
+// FNV-1a over the bytes, starting from 'h'.
+uint64_t Hash_Bytes(uint64_t h, const char* p, size_t len) {
+    for (size_t i = 0; i < len; ++i)
+        h = (h ^ (unsigned char) p[i]) * 0x100000001B3ull;
+    return h;
+}
+
+// The splitmix64 finalizer, so that each child's hash reaches every bit.
+uint64_t Mix_Hash(uint64_t h) {
+    h = (h ^ (h >> 30)) * 0xBF58476D1CE4E5B9ull;
+    h = (h ^ (h >> 27)) * 0x94D049BB133111EBull;
+    return h ^ (h >> 31);
+}
+
+void Index_Node(const TreeNode* n) {
+    Kind_Index -> by_kind[n -> kind].push_back(n);
+    const TreeNode* named = n -> left.get();
+    if (named && named -> kind == SUBC_IDENTIFIER)
+        named = named -> left.get();
+    if (named && named -> kind == SUBC_TEXT)
+        Kind_Index -> by_name[n -> kind][named -> token.value].push_back(n);
+}
+
+// Appends 'from' to 'into', as if its nodes had been indexed after those
+// already in 'into'.
+void Merge_Index(Node_Index& into, Node_Index& from) {
+    for (int k = 0; k < SUBC_NUM_KINDS; ++k) {
+        vector<const TreeNode*>& nodes = into.by_kind[k];
+        nodes.insert(nodes.end(), from.by_kind[k].begin(), from.by_kind[k].end());
+        for (auto& entry : from.by_name[k]) {
+            vector<const TreeNode*>& named = into.by_name[k][entry.first];
+            named.insert(named.end(), entry.second.begin(), entry.second.end());
+        }
+    }
+}
+
+// Parses the source selected by Set_Source() or Set_Stream_Source(),
+// listing its nodes in 'index' if one is given and skipping function
+// bodies if 'lazy' is set.
+unique_ptr<TreeNode> Parse_Source(Node_Index* index, bool lazy) {
+    while (!S.empty())
+        S.pop();
+    Kind_Index = index;
+    Lazy_Bodies = lazy;
+    try {
+        Get_Char();
+        Next_Token = Scan();
+        Tiny();
+    } catch (...) {
+        Kind_Index = nullptr;
+        Lazy_Bodies = false;
+        throw;
+    }
+    Kind_Index = nullptr;
+    Lazy_Bodies = false;
+    unique_ptr<TreeNode> root = move(S.top());
+    S.pop();
+    return root;
+}
+
+// Like Parse_Source(), but builds the tree hash-consed in 'pool'. The
+// pool's table is only needed while building, so it is freed afterwards.
+const Shared_Node* Parse_Shared_Source(Node_Pool& pool) {
+    Shared_Pool = &pool;
+    Shared_Stack.clear();
+    try {
+        Get_Char();
+        Next_Token = Scan();
+        Tiny();
+    } catch (...) {
+        Shared_Pool = nullptr;
+        throw;
+    }
+    Shared_Pool = nullptr;
+    pool.table = decltype(pool.table)();
+    const Shared_Node* root = Shared_Stack.back();
+    Shared_Stack.clear();
+    return root;
+}
+
+// Returns the pool's node for (label, children), creating it if this is
+// the first subtree of its shape.
+const Shared_Node* Intern(const string& label, uint32_t offset, const Shared_Node* const* children, int n) {
+    Node_Pool& P = *Shared_Pool;
+    const string* l = &*P.labels.insert(label).first;
+    size_t h = (size_t) l * 0x9E3779B97F4A7C15ull;
+    for (int i = 0; i < n; ++i)
+        h ^= children[i] -> hash + 0x9E3779B97F4A7C15ull + (h << 6) + (h >> 2);
+    Shared_Node key = Shared_Node{l, offset, n, children, h};
+    auto it = P.table.find(&key);
+    if (it != P.table.end())
+        return *it;
+
+    if (P.slots_left < (size_t) n) {
+        P.slots_left = std::max<size_t>(n, std::min<size_t>(std::max<size_t>(P.nodes.size(), 256), 1 << 16));
+        P.slot_blocks.push_back(unique_ptr<const Shared_Node*[]>(new const Shared_Node*[P.slots_left]));
+        P.next_slot = P.slot_blocks.back().get();
+        P.slot_bytes += P.slots_left * sizeof(const Shared_Node*);
+    }
+    const Shared_Node** slots = P.next_slot;
+    std::copy(children, children + n, slots);
+    P.next_slot += n;
+    P.slots_left -= n;
+    P.nodes.push_back(Shared_Node{l, offset, n, slots, h});
+    P.table.insert(&P.nodes.back());
+    return &P.nodes.back();
+}
+
+void Tiny() {
+    PROFILE_RULE();
+    uint32_t start = Next_Token.offset;
+    Read(T_program);
+    Name();
+    Read(T_colon);
+    Consts();
+    Types();
+    Dclns();
+    SubProgs();
+    Body();
+    Name();
+    Read(T_dot);
+    Build_Tree(SUBC_PROGRAM, 7, start);
+}
+
+void Name() {
+    PROFILE_RULE();
+    if (Next_Token.token_type == ID)
+        Read(Next_Token);
+    else
+        throw runtime_error(Diagnostic(Next_Token.offset, "Name() Expected an identifier"));
+}
+
+void Consts() {
+    PROFILE_RULE();
+    uint32_t start = Next_Token.offset;
+    int N = 1;
+    if (Next_Token == T_const) {
+        Read(T_const);
+        Const();
+        while (Next_Token == T_comma) {
+            Read(T_comma);
+            Const();
+            N++;
+        }
+        Read (T_semicolon);
+        Build_Tree(SUBC_CONSTS, N, start);
+    } else {
+        Build_Tree(SUBC_CONSTS, 0, start);
+    }
+}
+
+void Const() {
+    PROFILE_RULE();
+    Name();
+    Read(T_equals);
+    ConstValue();
+    Build_Tree(SUBC_CONST, 2);
+}
+
+void ConstValue() {
+    PROFILE_RULE();
+    switch (Next_Token.token_type){
+        case INT:
+            Read(Next_Token);
+            break;
+        case CHAR:
+            Read(Next_Token);
+            break;
+        case ID:
+            Name();
+            break;
+        default:
+            throw runtime_error(Diagnostic(Next_Token.offset, "Unresolved Next_Token.token_type in ConstValue()"));
+            break;
+    }
+
+}
+
+void Types() {
+    PROFILE_RULE();
+    uint32_t start = Next_Token.offset;
+    int N = 1;
+    if (Next_Token == T_type) {
+        Read(T_type);
+        Type();
+        Read(T_semicolon);
+        while (Next_Token.token_type == ID) {
+            Type();
+            Read(T_semicolon);
+            N++;
+        }
+        Build_Tree(SUBC_TYPES, N, start);
+    } else {
+        Build_Tree(SUBC_TYPES, 0, start);
+    }
+}
+
+void Type() {
+    PROFILE_RULE();
+    Name();
+    Read(T_equals);
+    LitList();
+    Build_Tree(SUBC_TYPE, 2);
+}
+
+void LitList() {
+    PROFILE_RULE();
+    uint32_t start = Next_Token.offset;
+    int N = 1;
+    Read(T_open_parenthesis);
+    Name();
+    while (Next_Token == T_comma) {
+        Read(T_comma);
+        Name();
+        N++;
+    }
+    Read(T_close_parenthesis);
+    Build_Tree(SUBC_LIT, N, start);
+}
+
+void Dclns() {
+    PROFILE_RULE();
+    uint32_t start = Next_Token.offset;
+    int N = 1;
+    if (Next_Token == T_var){
+        Read(T_var);
+        Dcln();
+        Read(T_semicolon);
+        while (Next_Token.token_type == ID) {
+            Dcln();
+            Read(T_semicolon);
+            N++;
+        }
+        Build_Tree(SUBC_DCLNS, N, start);
+    } else {
+        Build_Tree(SUBC_DCLNS, 0, start);
+    }
+
+}
+
+void Dcln() {
+    PROFILE_RULE();
+   int N = 1;
+   Name();
+   while (Next_Token == T_comma) {
+       Read(T_comma);
+       Name();
+       N++;
+   }
+   Read(T_colon);
+   Name();
+   Build_Tree(SUBC_VAR, N+1);
+}
+
+void SubProgs() {
+    PROFILE_RULE();
+    int N = 0;
+    bool streaming = Function_Parsed && !Shared_Pool;
+    if (Parse_Threads > 1 && !streaming && !Shared_Pool && Next_Token == T_function)
+        N = Parallel_Fcns();
+    while (Next_Token == T_function) {
+        Fcn();
+        N++;
+        if (streaming) {
+            Function_Parsed(move(S.top()));
+            S.pop();
+        }
+    }
+    if (streaming) {
+        Build_Tree(SUBC_SUBPROGS, 0);
+        S.top() -> num_children = N;
+    } else {
+        Build_Tree(SUBC_SUBPROGS, N);
+    }
+}
+
+void Fcn() {
+    PROFILE_RULE();
+    uint32_t start = Next_Token.offset;
+    Read(T_function);
+    Name();
+    Read(T_open_parenthesis);
+    Params();
+    Read(T_close_parenthesis);
+    Read(T_colon);
+    Name();
+    Read(T_semicolon);
+    if (Lazy_Bodies) {
+        Skip_Body();
+        Name();
+        Read(T_semicolon);
+        Build_Tree(SUBC_FCN, 5, start);
+        return;
+    }
+    Consts();
+    Types();
+    Dclns();
+    Body();
+    Name();
+    Read(T_semicolon);
+    Build_Tree(SUBC_FCN, 8, start);
+}
+
+// Pushes a <body> leaf for the consts, types, dclns and block that follow,
+// without parsing them: only 'begin' and 'case' open a construct that
+// 'end' closes, so the body ends at the 'end' that closes its 'begin'. The
+// bytes are skipped the way Function_Offsets() skips them, since building
+// tokens would cost most of what parsing them does. The leaf's offset is
+// where the body starts, and the function's closing name follows it, so
+// Parse_Body() knows where the body ends. The leaf is never indexed, since
+// Parse_Body() frees it. Needs a source selected by Set_Source().
+void Skip_Body() {
+    PROFILE_RULE();
+    uint32_t start = Next_Token.offset;
+    const char* p = src.begin + start;
+    const char* end = src.end;
+    int depth = 0;
+    while (true) {
+        if (p >= end)
+            throw runtime_error(Diagnostic(start, "Function body is not closed by 'end'."));
+        char ch = *p;
+        const char* close = nullptr;
+        if (ch == '{')
+            close = (const char*) memchr(p + 1, '}', end - p - 1);
+        else if (ch == '#')
+            close = (const char*) memchr(p + 1, '\n', end - p - 1);
+        else if (ch == '\'' || ch == '\"')
+            close = (const char*) memchr(p + 1, ch, end - p - 1);
+        else if (ch == '_' || isalpha(ch)) {
+            const char* q = p + 1;
+            while (q < end && (*q == '_' || isalnum(*q)))
+                q++;
+            if ((q - p == 5 && memcmp(p, "begin", 5) == 0) || (q - p == 4 && memcmp(p, "case", 4) == 0))
+                depth++;
+            else if (q - p == 3 && memcmp(p, "end", 3) == 0 && --depth == 0) {
+                p = q;
+                break;
+            }
+            p = q;
+            continue;
+        } else {
+            p++;
+            continue;
+        }
+        p = close ? close + 1 : end;
+    }
+    src.next = p;
+    Get_Char();
+    Next_Token = Scan();
+    S.push(make_unique<TreeNode>(TreeNode{0, SUBC_BODY, Token{KEYWORD, Kind_Names[SUBC_BODY], start}, nullptr, nullptr}));
+    // Hashed by its text, so a changed body changes the function's hash
+    S.top() -> hash = Mix_Hash(Hash_Bytes(0xCBF29CE484222325ull ^ SUBC_BODY, src.begin + start, p - src.begin - start));
+}
+
+// Replaces the <body> leaf Skip_Body() left in 'fcn' by the consts, types,
+// dclns and block it stands for, parsed from the source at 'begin'.
+void Parse_Body(TreeNode* fcn, const char* begin, Node_Index* index) {
+    PROFILE_RULE();
+    TreeNode* rettype = fcn -> left -> right -> right.get();
+    TreeNode* body = rettype -> right.get();
+    if (body -> kind != SUBC_BODY)
+        return;
+    while (!S.empty())
+        S.pop();
+    Set_Source(begin, body -> token.offset, body -> right -> token.offset);
+    // Indexed apart, so that a body that fails leaves no freed nodes listed
+    Node_Index body_index;
+    Kind_Index = index ? &body_index : nullptr;
+    try {
+        Get_Char();
+        Next_Token = Scan();
+        Consts();
+        Types();
+        Dclns();
+        Body();
+        if (Next_Token.token_type != END_TOKEN)
+            throw runtime_error(Diagnostic(Next_Token.offset, "Function body continues past its closing 'end'."));
+    } catch (...) {
+        Kind_Index = nullptr;
+        throw;
+    }
+    Kind_Index = nullptr;
+    if (index)
+        Merge_Index(*index, body_index);
+    unique_ptr<TreeNode> p = move(body -> right);
+    for (int i = 0; i < 4; ++i) {
+        unique_ptr<TreeNode> c = move(S.top());
+        S.pop();
+        c -> right = move(p);
+        p = move(c);
+    }
+    rettype -> right = move(p);
+    fcn -> num_children = 8;
+}
+
+// Parses all but the last function on Parse_Threads threads, pushing their
+// subtrees onto S in source order, and leaves the scanner on the last one.
+// Functions cannot nest, so every 'function' keyword starts a chunk; a chunk
+// only counts if Fcn() consumes exactly that chunk. If any chunk fails, the
+// scanner is left where it was and 0 is returned, so the sequential loop
+// reports the same error it always would.
+int Parallel_Fcns() {
+    size_t start = Next_Token.offset;
+    vector<size_t> offsets = Function_Offsets(src.begin, src.begin + start, src.end);
+    if (offsets.size() < 2 || offsets.front() != start)
+        return 0;
+
+    size_t chunks = offsets.size() - 1;
+    vector<unique_ptr<TreeNode>> results(chunks);
+    Node_Index* index = Kind_Index;
+    bool lazy = Lazy_Bodies;
+    vector<Node_Index> chunk_index(index ? chunks : 0);
+    std::atomic<size_t> next_chunk(0);
+    std::atomic<bool> failed(false);
+    const char* begin = src.begin;
+    auto worker = [&]() {
+        for (size_t i = next_chunk++; i < chunks && !failed; i = next_chunk++) {
+            try {
+                Kind_Index = index ? &chunk_index[i] : nullptr;
+                Lazy_Bodies = lazy;
+                Set_Source(begin, offsets[i], offsets[i + 1]);
+                Get_Char();
+                Next_Token = Scan();
+                Fcn();
+                if (Next_Token.token_type != END_TOKEN || S.size() != 1)
+                    failed = true;
+                else
+                    results[i] = move(S.top());
+            } catch (const std::exception&) {
+                failed = true;
+            }
+            while (!S.empty())
+                S.pop();
+        }
+    };
+
+    // The calling thread works too, on an empty stack of its own
+    Source saved_src = src;
+    char saved_c = c;
+    Token saved_token = Next_Token;
+    std::stack<unique_ptr<TreeNode>> saved_stack;
+    saved_stack.swap(S);
+    vector<std::thread> pool;
+    for (unsigned t = 1; t < Parse_Threads && t < chunks; ++t)
+        pool.push_back(std::thread(worker));
+    worker();
+    for (std::thread& t : pool)
+        t.join();
+    S.swap(saved_stack);
+    src = saved_src;
+    c = saved_c;
+    Next_Token = saved_token;
+    Line_Index.clear();
+    Kind_Index = index;
+    Lazy_Bodies = lazy;
+    if (failed)
+        return 0;
+
+    for (unique_ptr<TreeNode>& fcn : results)
+        S.push(move(fcn));
+    for (Node_Index& part : chunk_index)
+        Merge_Index(*index, part);
+    Set_Source(begin, offsets.back(), src.end - begin);
+    Get_Char();
+    Next_Token = Scan();
+    return (int) chunks;
+}
+
+// Offsets of every 'function' keyword in [p, end), skipping comments and
+// literals the same way Scan() does.
+vector<size_t> Function_Offsets(const char* begin, const char* p, const char* end) {
+    vector<size_t> offsets;
+    while (p < end) {
+        char ch = *p;
+        const char* close = nullptr;
+        if (ch == '{')
+            close = (const char*) memchr(p + 1, '}', end - p - 1);
+        else if (ch == '#')
+            close = (const char*) memchr(p + 1, '\n', end - p - 1);
+        else if (ch == '\'' || ch == '\"')
+            close = (const char*) memchr(p + 1, ch, end - p - 1);
+        else if (ch == '_' || isalpha(ch)) {
+            const char* q = p + 1;
+            while (q < end && (*q == '_' || isalnum(*q)))
+                q++;
+            if (q - p == 8 && memcmp(p, "function", 8) == 0)
+                offsets.push_back(p - begin);
+            p = q;
+            continue;
+        } else {
+            p++;
+            continue;
+        }
+        if (!close)
+            break;
+        p = close + 1;
+    }
+    return offsets;
+}
+
+void Params() {
+    PROFILE_RULE();
+    int N = 1;
+    Dcln();
+    while (Next_Token == T_semicolon) {
+        Read(T_semicolon);
+        Dcln();
+        N++;
+    }
+    Build_Tree(SUBC_PARAMS, N);
+}
+
+void Body() {
+    PROFILE_RULE();
+    uint32_t start = Next_Token.offset;
+    int N = 1;
+    Read(T_begin);
+    Statement();
+    while (Next_Token == T_semicolon) {
+        Read(T_semicolon);
+        Statement();
+        N++;
+    }
+    Read(T_end);
+    Build_Tree(SUBC_BLOCK, N, start);
+
+}
+
+void Statement() {
+    PROFILE_RULE();
+    Nesting_Level level;
+    level.add();
+    uint32_t start = Next_Token.offset;
+    if (Next_Token.token_type == ID) {
+        Assignment();
+    } else{
+        int N = 1;
+        if (Next_Token == T_output) {
+            Read(T_output);
+            Read(T_open_parenthesis);
+            OutExp();
+            while (Next_Token == T_comma) {
+                Read(T_comma);
+                OutExp();
+                N++;
+            }
+            Read(T_close_parenthesis);
+            Build_Tree(SUBC_OUTPUT, N, start);
+        } else if (Next_Token == T_if) {
+            Read(T_if);
+            Expression();
+            Read(T_then);
+            Statement();
+            if (Next_Token == T_else) {
+                Read(T_else);
+                Statement();
+                N++;
+            }
+            Build_Tree(SUBC_IF, N+1, start);
+        } else if (Next_Token == T_while) {
+            Read(T_while);
+            Expression();
+            Read(T_do);
+            Statement();
+            Build_Tree(SUBC_WHILE, 2, start);
+        } else if (Next_Token == T_repeat) {
+            Read(T_repeat);
+            Statement();
+            while (Next_Token == T_semicolon) {
+                Read(T_semicolon);
+                Statement();
+                N++;
+            }
+            Read(T_until);
+            Expression();
+            Build_Tree(SUBC_REPEAT, N+1, start);
+        } else if (Next_Token == T_for) {
+            Read(T_for);
+            Read(T_open_parenthesis);
+            ForStat();
+            Read(T_semicolon);
+            ForExp();
+            Read(T_semicolon);
+            ForStat();
+            Read(T_close_parenthesis);
+            Statement();
+            Build_Tree(SUBC_FOR, 4, start);
+        } else if (Next_Token == T_loop) {
+            Read(T_loop);
+            Statement();
+            while (Next_Token == T_semicolon) {
+                Read(T_semicolon);
+                Statement();
+                N++;
+            }
+            Read(T_pool);
+            Build_Tree(SUBC_LOOP, N, start);
+        } else if (Next_Token == T_case) {
+            Read(T_case);
+            Expression();
+            Read(T_of);
+            Caseclause();
+            Read(T_semicolon);
+            while (Next_Token.token_type == ID || Next_Token.token_type == CHAR
+                   ||Next_Token.token_type == INT) {
+                Caseclause();
+                Read(T_semicolon);
+                N++;
+            }
+            int P = 0;
+            if (Next_Token == T_otherwise)
+                P++;
+            OtherwiseClause();
+            Read(T_end);
+            Build_Tree(SUBC_CASE, N+P+1, start);
+        } else if (Next_Token == T_read) {
+            Read(T_read);
+            Read(T_open_parenthesis);
+            Name();
+            while (Next_Token == T_comma) {
+                Read(T_comma);
+                Name();
+                N++;
+            }
+            Read(T_close_parenthesis);
+            Build_Tree(SUBC_READ, N, start);
+        } else if (Next_Token == T_exit) {
+            Read(T_exit);
+            Build_Tree(SUBC_EXIT, 0, start);
+        } else if (Next_Token == T_return) {
+            Read(T_return);
+            Expression();
+            Build_Tree(SUBC_RETURN, 1, start);
+        } else if (Next_Token == T_begin) {
+            Body();
+        } else {
+            Build_Tree(SUBC_NULL, 0, start);
+        }
+    }
+}
+
+void Assignment() {
+    PROFILE_RULE();
+    Name();
+    if (Next_Token == T_colon_equals) {
+        Read(T_colon_equals);
+        Expression();
+        Build_Tree(SUBC_ASSIGN, 2);
+    } else {
+        Read(T_colon_equals_colon);
+        Name();
+        Build_Tree(SUBC_SWAP, 2);
+    }
+}
+
+void Expression() {
+    PROFILE_RULE();
+    Term();
+    if (Next_Token == T_less_equals) {
+        Read(T_less_equals);
+        Term();
+        Build_Tree(SUBC_LE, 2);
+    } else if (Next_Token == T_less) {
+        Read(T_less);
+        Term();
+        Build_Tree(SUBC_LT, 2);
+    } else if (Next_Token == T_greater) {
+        Read(T_greater);
+        Term();
+        Build_Tree(SUBC_GT, 2);
+    } else if (Next_Token == T_greater_equals) {
+        Read(T_greater_equals);
+        Term();
+        Build_Tree(SUBC_GE, 2);
+    } else if (Next_Token == T_equals) {
+        Read(T_equals);
+        Term();
+        Build_Tree(SUBC_EQ, 2);
+    } else if (Next_Token == T_not_equals) {
+        Read(T_not_equals);
+        Term();
+        Build_Tree(SUBC_NE, 2);
+    }
+}
+
+void Term() {
+    PROFILE_RULE();
+    Factor();
+    while (Next_Token == T_plus || Next_Token == T_minus || Next_Token == T_or) {
+        subc_kind kind = Next_Token == T_plus ? SUBC_PLUS : Next_Token == T_minus ? SUBC_MINUS : SUBC_OR;
+        Read(Next_Token);
+        Factor();
+        Build_Tree(kind, 2);
+    }
+}
+
+void Factor() {
+    PROFILE_RULE();
+    Primary();
+    while (Next_Token == T_star || Next_Token == T_slash || Next_Token == T_and || Next_Token == T_mod) {
+        subc_kind kind = Next_Token == T_star ? SUBC_TIMES : Next_Token == T_slash ? SUBC_DIVIDE
+                       : Next_Token == T_and ? SUBC_AND : SUBC_MOD;
+        Read(Next_Token);
+        Primary();
+        Build_Tree(kind, 2);
+    }
+}
+
+void Primary() {
+    PROFILE_RULE();
+    Nesting_Level level;
+    level.add();
+    uint32_t start = Next_Token.offset;
+    int N = 1;
+    if (Next_Token.token_type == ID) {
+        Name();
+        if (Next_Token == T_open_parenthesis){
+            Read(T_open_parenthesis);
+            Expression();
+            while (Next_Token == T_comma) {
+                Read(T_comma);
+                Expression();
+                N++;
+            }
+            Read(T_close_parenthesis);
+            Build_Tree(SUBC_CALL, N+1, start);
+        }
+    } else if (Next_Token.token_type == INT) {
+        Read(Next_Token);
+    } else if (Next_Token.token_type == CHAR) {
+        Read(Next_Token);
+    } else {
+        if (Next_Token == T_minus) {
+            Read(T_minus);
+            Primary();
+            Build_Tree(SUBC_MINUS, 1, start);
+        } else if (Next_Token == T_plus) {
+            Read(T_plus);
+            Primary();
+        } else if (Next_Token == T_not) {
+            Read(T_not);
+            Primary();
+            Build_Tree(SUBC_NOT, 1, start);
+        } else if (Next_Token == T_eof) {
+            Read(T_eof);
+            Build_Tree(SUBC_EOF, 0, start);
+        } else if (Next_Token == T_open_parenthesis) {
+            Read(T_open_parenthesis);
+            Expression();
+            Read(T_close_parenthesis);
+        } else if (Next_Token == T_succ) {
+            Read(T_succ);
+            Read(T_open_parenthesis);
+            Expression();
+            Read(T_close_parenthesis);
+            Build_Tree(SUBC_SUCC, 1, start);
+        } else if (Next_Token == T_pred) {
+            Read(T_pred);
+            Read(T_open_parenthesis);
+            Expression();
+            Read(T_close_parenthesis);
+            Build_Tree(SUBC_PRED, 1, start);
+        } else if (Next_Token == T_chr) {
+            Read(T_chr);
+            Read(T_open_parenthesis);
+            Expression();
+            Read(T_close_parenthesis);
+            Build_Tree(SUBC_CHR, 1, start);
+        } else if (Next_Token == T_ord){
+            Read(T_ord);
+            Read(T_open_parenthesis);
+            Expression();
+            Read(T_close_parenthesis);
+            Build_Tree(SUBC_ORD, 1, start);
+        } else {
+            throw runtime_error(Diagnostic(Next_Token.offset, "Expected an expression but found '" +
+                                           Next_Token.value + "'."));
+        }
+    }
+}
+
+void OutExp() {
+    PROFILE_RULE();
+    if (Next_Token.token_type == STRING) {
+        StringNode();
+        Build_Tree(SUBC_OUT_STRING, 1);
+    } else {
+        Expression();
+        Build_Tree(SUBC_OUT_INTEGER, 1);
+    }
+}
+
+void StringNode() {
+    PROFILE_RULE();
+    if (Next_Token.token_type == STRING)
+        Read(Next_Token);
+    else
+        throw runtime_error(Diagnostic(Next_Token.offset, "Could not resolve Next_Token.token_type in StringNode()"));
+}
+
+void ForStat() {
+    PROFILE_RULE();
+    if (Next_Token.token_type == ID)
+        Assignment();
+    else {
+        Build_Tree(SUBC_NULL, 0);
+    }
+}
+
+void ForExp() {
+    PROFILE_RULE();
+    if (Next_Token.token_type == ID || Next_Token.token_type == CHAR || Next_Token.token_type == INT
+            || Next_Token == T_minus || Next_Token == T_plus || Next_Token == T_not
+            || Next_Token == T_eof || Next_Token == T_succ || Next_Token == T_pred
+            || Next_Token == T_chr || Next_Token == T_ord || Next_Token == T_open_parenthesis) {
+        Expression();
+    } else {
+        Build_Tree(SUBC_TRUE, 0);
+    }
+}
+
+void Caseclause() {
+    PROFILE_RULE();
+    int N = 1;
+    CaseExpression();
+    while (Next_Token == T_comma) {
+        Read(T_comma);
+        CaseExpression();
+        N++;
+    }
+    Read(T_colon);
+    Statement();
+    Build_Tree(SUBC_CASE_CLAUSE, N+1);
+}
+
+void CaseExpression() {
+    PROFILE_RULE();
+    ConstValue();
+    if (Next_Token == T_dotdot) {
+        Read(T_dotdot);
+        ConstValue();
+        Build_Tree(SUBC_RANGE, 2);
+    }
+}
+
+void OtherwiseClause() {
+    PROFILE_RULE();
+    uint32_t start = Next_Token.offset;
+    if (Next_Token == T_otherwise) {
+        Read(T_otherwise);
+        Statement();
+        Build_Tree(SUBC_OTHERWISE, 1, start);
+    }
+}
+
+
+
+/**************************** TABLE-DRIVEN PARSER ****************************/
+
+// The terminal of LL1_Terminals that a token is. The end of the source is
+// LL1_Eof, and so is a token the grammar never names.
+int Table_Terminal(const Token& t) {
+    static const std::unordered_map<string, int> spelled = [] {
+        std::unordered_map<string, int> terminals;
+        for (int i = 0; i < LL1_Num_Terminals; ++i)
+            terminals[LL1_Terminals[i]] = i;
+        return terminals;
+    }();
+    static const int identifier = spelled.at("<identifier>"), integer = spelled.at("<integer>"),
+            character = spelled.at("<char>"), string_literal = spelled.at("<string>");
+    switch (t.token_type) {
+        case ID:
+            return identifier;
+        case INT:
+            return integer;
+        case CHAR:
+            return character;
+        case STRING:
+            return string_literal;
+        case KEYWORD:
+        case DONT_CARE: {
+            auto it = spelled.find(t.value);
+            return it == spelled.end() ? LL1_Eof : it -> second;
+        }
+        default:
+            return LL1_Eof;
+    }
+}
+
+// The number of the first nonterminal with a name, which is the one the
+// grammar's rules refer to; the others are helpers ll1gen made for it.
+int Table_Nonterminal(const char* name) {
+    for (int i = 0; i < LL1_Num_Nonterminals; ++i)
+        if (strcmp(LL1_Nonterminals[i], name) == 0)
+            return i;
+    throw runtime_error(string("The grammar has no nonterminal ") + name + ".");
+}
+
+// Parses the source selected by Set_Source() into the same tree as
+// Parse_Source(), driven by the tables ll1gen generates from
+// docs/grammar.txt instead of the productions above, which 'p1 -ll1' checks
+// it against. The parse stack is explicit, but nesting is bounded as the
+// productions bound it, so that both parsers reject the same programs: by
+// the Statements and Primaries being parsed at once.
+unique_ptr<TreeNode> Parse_Table_Source() {
+    static const vector<subc_kind> kinds = [] {
+        vector<subc_kind> labels;
+        for (const char* label : LL1_Labels) {
+            int k = 0;
+            while (k < SUBC_TEXT && strcmp(Kind_Names[k], label) != 0)
+                k++;
+            if (k == SUBC_TEXT)
+                throw runtime_error(string("The grammar labels nodes \"") + label + "\", which is not a node kind.");
+            labels.push_back((subc_kind) k);
+        }
+        return labels;
+    }();
+    static const int statement = Table_Nonterminal("Statement"), primary = Table_Nonterminal("Primary");
+    while (!S.empty())
+        S.pop();
+    Get_Char();
+    Next_Token = Scan();
+    int next = Table_Terminal(Next_Token);
+    vector<LL1_Symbol> stack(1, LL1_Symbol{LL1_NONTERMINAL, 0, 0});
+    vector<std::pair<size_t, int64_t>> marks;  // S.size() and the offset of the node to build
+    int nesting = 0;
+    while (!stack.empty()) {
+        LL1_Symbol s = stack.back();
+        stack.pop_back();
+        if (s.op == LL1_NONTERMINAL) {
+            int p = LL1_Predict[s.value][next];
+            if (p < 0) {
+                string expected;
+                for (int t = 0; t < LL1_Num_Terminals; ++t)
+                    if (LL1_Predict[s.value][t] >= 0)
+                        expected += (expected.empty() ? "'" : ", '") + string(LL1_Terminals[t]) + "'";
+                throw runtime_error(Diagnostic(Next_Token.offset, string(LL1_Nonterminals[s.value]) +
+                                               " expected one of " + expected + " but found '" + Next_Token.value + "'."));
+            }
+            if (s.value == statement || s.value == primary) {
+                if (++nesting > Max_Nesting)
+                    throw runtime_error(Diagnostic(Next_Token.offset, "Program is nested more than " +
+                                                   std::to_string(Max_Nesting) + " levels deep."));
+                stack.push_back(LL1_Symbol{LL1_LEAVE, 0, 0});
+            }
+            stack.insert(stack.end(), LL1_Rhs + LL1_Rhs_Start[p], LL1_Rhs + LL1_Rhs_Start[p + 1]);
+        } else if (s.op == LL1_TERMINAL) {
+            if (s.value != next)
+                throw runtime_error(Diagnostic(Next_Token.offset, "Token did not match expected value: expected '" +
+                                               string(LL1_Terminals[s.value]) + "' but found '" + Next_Token.value + "'."));
+            if (Next_Token.token_type == KEYWORD || Next_Token.token_type == DONT_CARE) {
+                Next_Token = Scan();
+            } else {
+                Read(Next_Token);
+            }
+            next = Table_Terminal(Next_Token);
+        } else if (s.op == LL1_LEAVE) {
+            nesting--;
+        } else if (s.op == LL1_MARK) {
+            marks.push_back(std::make_pair(S.size(), s.value ? (int64_t) Next_Token.offset : -1));
+        } else {
+            int n = (int) (S.size() - marks.back().first) + s.extra;
+            Build_Tree(kinds[s.value], n, marks.back().second);
+            marks.pop_back();
+        }
+    }
+    unique_ptr<TreeNode> root = move(S.top());
+    S.pop();
+    return root;
+}
+
+
+#ifdef SUBC_PROFILE
+/**************************** PROFILER ****************************/
+
+// Returns the id of a rule, given the name of its function. Called once
+// per rule, from the static in PROFILE_RULE().
+int Register_Rule(const char* name) {
+    std::lock_guard<std::mutex> hold(Profile_Lock);
+    Rule_Names.push_back(name);
+    return (int) Rule_Names.size() - 1;
+}
+
+// The calling thread's profile, created on first use. Profiles outlive
+// their threads, so the workers of Parallel_Fcns() are counted too.
+Thread_Profile* Profile_Here() {
+    if (!Profile_Current) {
+        std::lock_guard<std::mutex> hold(Profile_Lock);
+        Profiles.push_back(make_unique<Thread_Profile>());
+        Profiles.back() -> id = (int) Profiles.size() - 1;
+        Profile_Current = Profiles.back().get();
+    }
+    return Profile_Current;
+}
+
+uint64_t Profile_Now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - Profile_Epoch).count();
+}
+
+// Clears the counters, and records a trace event per rule activation from
+// now on if 'trace' is set. Must be called before any thread parses.
+void Start_Profile(bool trace) {
+    std::lock_guard<std::mutex> hold(Profile_Lock);
+    Profiles.clear();
+    Profile_Current = nullptr;
+    Profile_Trace = trace;
+}
+
+vector<string> Profile_Rule_Names() {
+    std::lock_guard<std::mutex> hold(Profile_Lock);
+    return Rule_Names;
+}
+
+vector<const Thread_Profile*> Profile_Threads() {
+    std::lock_guard<std::mutex> hold(Profile_Lock);
+    vector<const Thread_Profile*> threads;
+    for (const unique_ptr<Thread_Profile>& P : Profiles)
+        threads.push_back(P.get());
+    return threads;
+}
+
+Rule_Scope::Rule_Scope(int rule) {
+    Thread_Profile* P = Profile_Here();
+    if ((size_t) rule >= P -> rules.size())
+        P -> rules.resize(rule + 1);
+    P -> rules[rule].calls++;
+    P -> rules[rule].active++;
+    P -> frames.push_back(Rule_Frame{rule, Profile_Now(), 0, P -> tokens});
+}
+
+Rule_Scope::~Rule_Scope() {
+    Thread_Profile* P = Profile_Here();
+    Rule_Frame frame = P -> frames.back();
+    P -> frames.pop_back();
+    uint64_t spent = Profile_Now() - frame.start_ns;
+    Rule_Stats& stats = P -> rules[frame.rule];
+    stats.exclusive_ns += spent - frame.child_ns;
+    if (--stats.active == 0) {
+        stats.inclusive_ns += spent;
+        stats.tokens += P -> tokens - frame.tokens;
+    }
+    if (!P -> frames.empty())
+        P -> frames.back().child_ns += spent;
+    if (Profile_Trace && P -> events.size() < Max_Trace_Events)
+        P -> events.push_back(Trace_Event{frame.rule, frame.start_ns, spent});
+    else if (Profile_Trace)
+        P -> dropped_events++;
+}
+#endif
+
+
+/**************************** LIBRARY API ****************************/
+
+struct subc_ast {
+    subc::Ast ast;
+    string error;
+    string expand_error;    // the last subc_expand() failure
+};
+
+namespace subc {
+
+const string& Node::label() const {
+    return node -> token.value;
+}
+
+subc_kind Node::kind() const {
+    return node -> kind;
+}
+
+int Node::num_children() const {
+    return node -> num_children;
+}
+
+Node Node::first_child() const {
+    return Node(node -> left.get());
+}
+
+Node Node::next_sibling() const {
+    return Node(node -> right.get());
+}
+
+Node Node::child(int i) const {
+    Node n = first_child();
+    while (n && i-- > 0)
+        n = n.next_sibling();
+    return n;
+}
+
+uint32_t Node::offset() const {
+    return node -> token.offset;
+}
+
+uint64_t Node::hash() const {
+    return node -> hash;
+}
+
+int64_t Node::number() const {
+    return node -> token.number;
+}
+
+string Node::string_value() const {
+    size_t len;
+    const char* text = subc_string_value(node, &len);
+    return text ? string(text, len) : string();
+}
+
+Ast::Ast() : source(nullptr) {}
+Ast::Ast(unique_ptr<TreeNode> root, unique_ptr<Node_Index> nodes, const char* lazy_source)
+    : tree(move(root)), index(move(nodes)), source(lazy_source) {}
+Ast::Ast(Ast&& other) = default;
+Ast& Ast::operator=(Ast&& other) = default;
+Ast::~Ast() = default;
+
+Node Ast::root() const {
+    return Node(tree.get());
+}
+
+Node_Range Ast::nodes(subc_kind kind) const {
+    if (!index)
+        throw runtime_error("The tree was parsed without an index.");
+    const vector<const TreeNode*>& nodes = index -> by_kind[kind];
+    return Node_Range(nodes.data(), nodes.data() + nodes.size());
+}
+
+Node_Range Ast::nodes(subc_kind kind, const string& name) const {
+    if (!index)
+        throw runtime_error("The tree was parsed without an index.");
+    auto it = index -> by_name[kind].find(name);
+    if (it == index -> by_name[kind].end())
+        return Node_Range();
+    return Node_Range(it -> second.data(), it -> second.data() + it -> second.size());
+}
+
+void Ast::expand(Node fcn) {
+    if (source && fcn.kind() == SUBC_FCN && fcn.num_children() < 8)
+        Parse_Body(const_cast<TreeNode*>(fcn.get()), source, index.get());
+}
+
+void Ast::expand_all() {
+    if (!source)
+        return;
+    for (Node n = root().first_child(); n; n = n.next_sibling())
+        if (n.kind() == SUBC_SUBPROGS)
+            for (Node fcn = n.first_child(); fcn; fcn = fcn.next_sibling())
+                expand(fcn);
+    source = nullptr;
+}
+
+const string& Dag_Node::label() const {
+    return *node -> label;
+}
+
+int Dag_Node::num_children() const {
+    return node -> num_children;
+}
+
+Dag_Node Dag_Node::child(int i) const {
+    return i >= 0 && i < node -> num_children ? Dag_Node(node -> children[i]) : Dag_Node();
+}
+
+uint32_t Dag_Node::offset() const {
+    return node -> offset;
+}
+
+size_t Dag_Node::hash() const {
+    return node -> hash;
+}
+
+Dag::Dag() : top(nullptr) {}
+Dag::Dag(unique_ptr<Node_Pool> p, const Shared_Node* root) : pool(move(p)), top(root) {}
+Dag::Dag(Dag&& other) = default;
+Dag& Dag::operator=(Dag&& other) = default;
+Dag::~Dag() = default;
+
+Dag_Node Dag::root() const {
+    return Dag_Node(top);
+}
+
+size_t Dag::num_nodes() const {
+    return pool ? pool -> nodes.size() : 0;
+}
+
+size_t Dag::bytes() const {
+    if (!pool)
+        return 0;
+    size_t n = pool -> nodes.size() * sizeof(Shared_Node) + pool -> slot_bytes;
+    n += pool -> labels.bucket_count() * sizeof(void*);
+    for (const string& l : pool -> labels)
+        n += sizeof(string) + 2 * sizeof(void*) + (l.capacity() > 15 ? l.capacity() + 1 : 0);
+    return n;
+}
+
+Ast parse(const char* buf, size_t len, unsigned options) {
+    unique_ptr<Node_Index> nodes(options & SUBC_INDEX ? new Node_Index() : nullptr);
+    bool lazy = (options & SUBC_LAZY_BODIES) != 0;
+    Set_Source(buf, 0, len);
+    unique_ptr<TreeNode> root = Parse_Source(nodes.get(), lazy);
+    return Ast(move(root), move(nodes), lazy ? buf : nullptr);
+}
+
+Dag parse_shared(const char* buf, size_t len) {
+    unique_ptr<Node_Pool> pool(new Node_Pool());
+    Set_Source(buf, 0, len);
+    const Shared_Node* root = Parse_Shared_Source(*pool);
+    return Dag(move(pool), root);
+}
+
+}
+
+subc_ast* subc_parse(const char* buf, size_t len) {
+    return subc_parse_options(buf, len, 0);
+}
+
+subc_ast* subc_parse_indexed(const char* buf, size_t len) {
+    return subc_parse_options(buf, len, SUBC_INDEX);
+}
+
+subc_ast* subc_parse_options(const char* buf, size_t len, unsigned options) {
+    subc_ast* result = new subc_ast();
+    try {
+        result -> ast = subc::parse(buf, len, options);
+    } catch (const std::exception& e) {
+        result -> error = e.what();
+    }
+    return result;
+}
+
+const char* subc_expand(subc_ast* ast, const subc_node* fcn) {
+    if (!ast -> error.empty())
+        return ast -> error.c_str();
+    try {
+        ast -> ast.expand(subc::Node(fcn));
+    } catch (const std::exception& e) {
+        ast -> expand_error = e.what();
+        return ast -> expand_error.c_str();
+    }
+    return nullptr;
+}
+
+const char* subc_error(const subc_ast* ast) {
+    return ast -> error.empty() ? nullptr : ast -> error.c_str();
+}
+
+void subc_free(subc_ast* ast) {
+    delete ast;
+}
+
+const subc_node* subc_root(const subc_ast* ast) {
+    return ast -> ast.root().get();
+}
+
+const subc_node* subc_first_child(const subc_node* node) {
+    return node -> left.get();
+}
+
+const subc_node* subc_next_sibling(const subc_node* node) {
+    return node -> right.get();
+}
+
+int subc_num_children(const subc_node* node) {
+    return node -> num_children;
+}
+
+subc_kind subc_node_kind(const subc_node* node) {
+    return node -> kind;
+}
+
+const char* subc_label(const subc_node* node, size_t* len) {
+    if (len)
+        *len = node -> token.value.size();
+    return node -> token.value.c_str();
+}
+
+uint32_t subc_offset(const subc_node* node) {
+    return node -> token.offset;
+}
+
+uint64_t subc_hash(const subc_node* node) {
+    return node -> hash;
+}
+
+int64_t subc_number(const subc_node* node) {
+    return node -> token.number;
+}
+
+const char* subc_string_value(const subc_node* node, size_t* len) {
+    if (node -> kind == SUBC_STRING)
+        node = node -> left.get();
+    const string& text = node -> token.value;
+    if (node -> kind != SUBC_TEXT || text.size() < 2 || text[0] != '"') {
+        *len = 0;
+        return nullptr;
+    }
+    *len = text.size() - 2;
+    return text.data() + 1;
+}
+
+const subc_node* const* subc_nodes(const subc_ast* ast, subc_kind kind, size_t* count) {
+    *count = 0;
+    if (!ast -> error.empty() || kind < 0 || kind >= SUBC_NUM_KINDS)
+        return nullptr;
+    try {
+        subc::Node_Range nodes = ast -> ast.nodes(kind);
+        *count = nodes.size();
+        return nodes.empty() ? nullptr : nodes.data();
+    } catch (const std::exception&) {
+        return nullptr;
+    }
+}
+
+const subc_node* const* subc_nodes_named(const subc_ast* ast, subc_kind kind, const char* name, size_t* count) {
+    *count = 0;
+    if (!ast -> error.empty() || kind < 0 || kind >= SUBC_NUM_KINDS)
+        return nullptr;
+    try {
+        subc::Node_Range nodes = ast -> ast.nodes(kind, name);
+        *count = nodes.size();
+        return nodes.empty() ? nullptr : nodes.data();
+    } catch (const std::exception&) {
+        return nullptr;
+    }
+}
@@ -0,0 +1,310 @@
+/*
+ * libsubc: the SUBC scanner and parser as a library.
+ *
+ * parse() takes the program text in memory and returns its abstract syntax
+ * tree, the same tree 'p1 -ast' prints. Nodes are handed out as views into
+ * the tree, so walking it copies nothing and no stream is involved. The C
+ * functions below wrap the same parser for use from C or through an FFI.
+ *
+ * A node's label is a production name ("program", "fcn", "<identifier>",
+ * ...) or, for the single child of an <identifier>, <integer>, <char> or
+ * <string> node, the text of that token. Offsets are byte offsets into the
+ * buffer that was parsed.
+ *
+ * parse_shared() builds the same tree hash-consed: every distinct subtree
+ * exists once, so the result is a DAG that is much smaller for large
+ * programs and compares subtrees in O(1). It is C++ only.
+ */
+#ifndef SUBC_H
+#define SUBC_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(__GNUC__)
+#define SUBC_API __attribute__((visibility("default")))
+#else
+#define SUBC_API
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct subc_node_impl subc_node;
+typedef struct subc_ast subc_ast;
+
+/* One kind per node label. SUBC_TEXT is the token text under an
+ * <identifier>, <integer>, <char> or <string> node; SUBC_OUT_INTEGER and
+ * SUBC_OUT_STRING are the 'integer' and 'string' items of an output list. */
+typedef enum subc_kind {
+    SUBC_PROGRAM, SUBC_CONSTS, SUBC_CONST, SUBC_TYPES, SUBC_TYPE, SUBC_LIT,
+    SUBC_DCLNS, SUBC_VAR, SUBC_SUBPROGS, SUBC_FCN, SUBC_PARAMS, SUBC_BLOCK,
+    SUBC_OUTPUT, SUBC_IF, SUBC_WHILE, SUBC_REPEAT, SUBC_FOR, SUBC_LOOP,
+    SUBC_CASE, SUBC_READ, SUBC_EXIT, SUBC_RETURN, SUBC_NULL, SUBC_ASSIGN,
+    SUBC_SWAP, SUBC_CASE_CLAUSE, SUBC_RANGE, SUBC_OTHERWISE, SUBC_OUT_STRING,
+    SUBC_OUT_INTEGER, SUBC_TRUE, SUBC_LE, SUBC_LT, SUBC_GT, SUBC_GE, SUBC_EQ,
+    SUBC_NE, SUBC_PLUS, SUBC_MINUS, SUBC_OR, SUBC_TIMES, SUBC_DIVIDE, SUBC_AND,
+    SUBC_MOD, SUBC_NOT, SUBC_EOF, SUBC_SUCC, SUBC_PRED, SUBC_CHR, SUBC_ORD,
+    SUBC_CALL, SUBC_IDENTIFIER, SUBC_INTEGER, SUBC_CHAR, SUBC_STRING, SUBC_BODY,
+    SUBC_TEXT, SUBC_NUM_KINDS
+} subc_kind;
+
+/* Options for subc_parse_options() and subc::parse(). SUBC_LAZY_BODIES
+ * skips each function's consts, types, dclns and block, leaving a <body>
+ * leaf in their place until subc_expand() parses them; the buffer must
+ * outlive the tree, and errors inside a body are reported by the expand. */
+enum {
+    SUBC_INDEX = 1,
+    SUBC_LAZY_BODIES = 2
+};
+
+/* Never returns NULL; check subc_error() before walking the tree. */
+SUBC_API subc_ast* subc_parse(const char* buf, size_t len);
+/* Also indexes the nodes of each kind, for subc_nodes(). */
+SUBC_API subc_ast* subc_parse_indexed(const char* buf, size_t len);
+SUBC_API subc_ast* subc_parse_options(const char* buf, size_t len, unsigned options);
+/* Parses the body of a 'fcn' node if it was skipped, or does nothing.
+ * NULL on success, otherwise a "line:col: message" diagnostic. */
+SUBC_API const char* subc_expand(subc_ast* ast, const subc_node* fcn);
+/* NULL if the parse succeeded, otherwise a "line:col: message" diagnostic. */
+SUBC_API const char* subc_error(const subc_ast* ast);
+SUBC_API void subc_free(subc_ast* ast);
+
+/* Navigation returns NULL past the last child or sibling. */
+SUBC_API const subc_node* subc_root(const subc_ast* ast);
+SUBC_API const subc_node* subc_first_child(const subc_node* node);
+SUBC_API const subc_node* subc_next_sibling(const subc_node* node);
+SUBC_API int subc_num_children(const subc_node* node);
+SUBC_API subc_kind subc_node_kind(const subc_node* node);
+/* NUL-terminated; *len receives the length unless len is NULL. */
+SUBC_API const char* subc_label(const subc_node* node, size_t* len);
+SUBC_API uint32_t subc_offset(const subc_node* node);
+/* A hash of the node's kind, text and children, but not their offsets:
+ * equal subtrees have equal hashes, in one tree or across parses. A <body>
+ * leaf hashes its source text, and an expanded function keeps the hash it
+ * had as one. */
+SUBC_API uint64_t subc_hash(const subc_node* node);
+/* Literal payloads, decoded by the scanner. subc_number() is the value of
+ * an <integer> or the code of a <char>, or of the text under one, and 0 for
+ * any other node. subc_string_value() is the text of a <string> between its
+ * quotes, not NUL-terminated; NULL with *len 0 for any other node. */
+SUBC_API int64_t subc_number(const subc_node* node);
+SUBC_API const char* subc_string_value(const subc_node* node, size_t* len);
+
+/* Every node of a kind in an indexed tree, children before parents. With a
+ * name, only the leaves with that text and the nodes whose first child is
+ * an <identifier> with that name, e.g. SUBC_CALL and "f" for all calls to
+ * f. Returns NULL with *count 0 if there are none or the tree has no index. */
+SUBC_API const subc_node* const* subc_nodes(const subc_ast* ast, subc_kind kind, size_t* count);
+SUBC_API const subc_node* const* subc_nodes_named(const subc_ast* ast, subc_kind kind,
+                                                  const char* name, size_t* count);
+
+#ifdef __cplusplus
+}
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace subc {
+
+// The library's own types, defined in subc_internal.h
+namespace detail {
+struct Shared_Node;
+struct Node_Pool;
+struct Node_Index;
+}
+
+// A node of an Ast, valid for as long as the Ast lives. Copying a Node
+// copies a pointer; a default-constructed Node is null.
+class SUBC_API Node {
+public:
+    Node() : node(nullptr) {}
+    explicit Node(const subc_node* n) : node(n) {}
+    explicit operator bool() const { return node != nullptr; }
+    const std::string& label() const;
+    subc_kind kind() const;
+    int num_children() const;
+    Node first_child() const;
+    Node next_sibling() const;
+    Node child(int i) const;
+    uint32_t offset() const;
+    uint64_t hash() const;          // see subc_hash()
+    int64_t number() const;         // see subc_number()
+    std::string string_value() const;
+    const subc_node* get() const { return node; }
+private:
+    const subc_node* node;
+};
+
+// A run of index entries; iterating it yields Nodes.
+class Node_Range {
+public:
+    class iterator {
+    public:
+        explicit iterator(const subc_node* const* p) : at(p) {}
+        Node operator*() const { return Node(*at); }
+        iterator& operator++() { ++at; return *this; }
+        bool operator!=(const iterator& other) const { return at != other.at; }
+    private:
+        const subc_node* const* at;
+    };
+    Node_Range() : first(nullptr), last(nullptr) {}
+    Node_Range(const subc_node* const* b, const subc_node* const* e) : first(b), last(e) {}
+    iterator begin() const { return iterator(first); }
+    iterator end() const { return iterator(last); }
+    size_t size() const { return last - first; }
+    bool empty() const { return first == last; }
+    Node operator[](size_t i) const { return Node(first[i]); }
+    const subc_node* const* data() const { return first; }
+private:
+    const subc_node* const* first;
+    const subc_node* const* last;
+};
+
+class SUBC_API Ast {
+public:
+    Ast();
+    explicit Ast(std::unique_ptr<subc_node> root, std::unique_ptr<detail::Node_Index> index = nullptr,
+                 const char* lazy_source = nullptr);
+    Ast(Ast&& other);
+    Ast& operator=(Ast&& other);
+    ~Ast();
+    Node root() const;
+    // Need an Ast parsed with an index, and throw std::runtime_error
+    // otherwise. Both run in time proportional to the nodes they return;
+    // see subc_nodes() for what they match.
+    Node_Range nodes(subc_kind kind) const;
+    Node_Range nodes(subc_kind kind, const std::string& name) const;
+    // Parse a body skipped by SUBC_LAZY_BODIES; expand() does nothing for
+    // a body that is already there. Both throw std::runtime_error for a
+    // body that does not parse, and must not run concurrently on one Ast.
+    void expand(Node fcn);
+    void expand_all();
+private:
+    std::unique_ptr<subc_node> tree;
+    std::unique_ptr<detail::Node_Index> index;
+    const char* source;
+};
+
+// Dispatches nodes through a table indexed by kind: visit(n) calls the
+// handler for n.kind(), or visits n's children if there is none. Children
+// are walked with a stack rather than by recursion, so a deep tree, such as
+// the left-deep one of a long chain like 1 + 1 + ..., only recurses as far
+// as the handlers do.
+class Visitor {
+public:
+    Visitor& on(subc_kind kind, std::function<void(Node)> handler) {
+        table[kind] = std::move(handler);
+        return *this;
+    }
+    void visit(Node n) const {
+        const std::function<void(Node)>& handler = table[n.kind()];
+        if (handler)
+            handler(n);
+        else
+            visit_children(n);
+    }
+    void visit_children(Node n) const {
+        std::vector<Node> pending;      // each to visit with its following siblings
+        if (n.first_child())
+            pending.push_back(n.first_child());
+        while (!pending.empty()) {
+            Node c = pending.back();
+            pending.pop_back();
+            if (c.next_sibling())
+                pending.push_back(c.next_sibling());
+            const std::function<void(Node)>& handler = table[c.kind()];
+            if (handler)
+                handler(c);
+            else if (c.first_child())
+                pending.push_back(c.first_child());
+        }
+    }
+private:
+    std::function<void(Node)> table[SUBC_NUM_KINDS];
+};
+
+// A node of a Dag. Equal subtrees are the same node, so == compares whole
+// subtrees in O(1). The offset is that of the subtree's first occurrence.
+class SUBC_API Dag_Node {
+public:
+    Dag_Node() : node(nullptr) {}
+    explicit Dag_Node(const detail::Shared_Node* n) : node(n) {}
+    explicit operator bool() const { return node != nullptr; }
+    bool operator==(Dag_Node other) const { return node == other.node; }
+    bool operator!=(Dag_Node other) const { return node != other.node; }
+    const std::string& label() const;
+    int num_children() const;
+    Dag_Node child(int i) const;
+    uint32_t offset() const;
+    size_t hash() const;
+    const detail::Shared_Node* get() const { return node; }
+private:
+    const detail::Shared_Node* node;
+};
+
+class SUBC_API Dag {
+public:
+    Dag();
+    Dag(std::unique_ptr<detail::Node_Pool> pool, const detail::Shared_Node* root);
+    Dag(Dag&& other);
+    Dag& operator=(Dag&& other);
+    ~Dag();
+    Dag_Node root() const;
+    size_t num_nodes() const;       // distinct subtrees
+    size_t bytes() const;           // heap held by the nodes and labels
+private:
+    std::unique_ptr<detail::Node_Pool> pool;
+    const detail::Shared_Node* top;
+};
+
+// Throws std::runtime_error with a "line:col: message" diagnostic if the
+// text is not a SUBC program. Safe to call from several threads at once.
+// 'options' is a combination of SUBC_INDEX, which lists the nodes of each
+// kind for Ast::nodes(), and SUBC_LAZY_BODIES.
+SUBC_API Ast parse(const char* buf, size_t len, unsigned options = 0);
+SUBC_API Dag parse_shared(const char* buf, size_t len);
+
+// Calls visit(node, depth) on node, its descendants and its following
+// siblings in the order 'p1 -ast' prints them. Like Visitor, it keeps a
+// stack of its own instead of recursing.
+template <typename F>
+void preorder(Node node, F&& visit, int depth = 0) {
+    std::vector<std::pair<Node, int>> pending;     // each to visit with its following siblings
+    if (node)
+        pending.push_back(std::make_pair(node, depth));
+    while (!pending.empty()) {
+        Node n = pending.back().first;
+        int d = pending.back().second;
+        pending.pop_back();
+        if (n.next_sibling())
+            pending.push_back(std::make_pair(n.next_sibling(), d));
+        visit(n, d);
+        if (n.first_child())
+            pending.push_back(std::make_pair(n.first_child(), d + 1));
+    }
+}
+
+// Calls visit(node, depth) on node and its descendants. A shared subtree is
+// visited once per occurrence, so this also prints as 'p1 -ast' does.
+template <typename F>
+void preorder(Dag_Node node, F&& visit, int depth = 0) {
+    std::vector<std::pair<Dag_Node, int>> pending(1, std::make_pair(node, depth));
+    while (!pending.empty()) {
+        Dag_Node n = pending.back().first;
+        int d = pending.back().second;
+        pending.pop_back();
+        visit(n, d);
+        for (int i = n.num_children() - 1; i >= 0; --i)
+            pending.push_back(std::make_pair(n.child(i), d + 1));
+    }
+}
+
+}
+
+#endif
+#endif
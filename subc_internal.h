@@ -0,0 +1,325 @@
+// Internal interface of libsubc: the scanner and parser state and entry
+// points shared by subc.cpp and p1. Embedders should use subc.h instead.
+#ifndef SUBC_INTERNAL_H
+#define SUBC_INTERNAL_H
+
+#include "subc.h"
+#include <memory>           // unique_ptr
+#include <utility>          // forward
+#include <stack>            // stack
+#include <string>           // string
+#include <vector>           // vector
+#include <deque>            // deque
+#include <unordered_set>    // unordered set
+#include <unordered_map>    // unordered map
+#include <algorithm>        // equal
+#include <stdexcept>        // runtime_error
+#include <cstdint>          // uint32_t
+
+
+
+/*******************  UTILITY FUNCTION FROM C++ 14 ******************/
+namespace subc {
+namespace detail {
+template<typename T, typename... Args>
+std::unique_ptr<T> make_unique(Args&&... args) {
+    return std::unique_ptr<T>(new T(std::forward<Args>(args)...));
+}
+}
+}
+
+
+
+/**************************** CONSTRUCTS ****************************/
+enum State {
+    START,
+    IDENTIFIER,
+    INTEGER,
+    OPEN_SINGLE_QUOTE,
+    OPEN_DOUBLE_QUOTE,
+    OPEN_CURLY_BRACKET,
+    OPEN_ANGLE_BRACKET,
+    CLOSE_ANGLE_BRACKET,
+    COLON,
+    COLON_EQUALS,
+    DOT,
+    OCTOTHORPE,
+    FINAL
+};
+enum Token_Type {
+    KEYWORD,
+    ID,
+    INT,
+    CHAR,
+    STRING,
+    COMMENT,
+    DONT_CARE,
+    END_TOKEN
+};
+struct Token {
+    Token_Type token_type;
+    uint32_t offset;        // byte offset of the first character in the source
+    std::string value;      // the text as written, quotes and all
+    int64_t number;         // an INT's value or a CHAR's code, decoded by the scanner
+    Token() : token_type(KEYWORD), offset(0), number(0) {}
+    // One per kind of text, so that the value is built in place rather than
+    // copied into a parameter and then moved, once per token and node.
+    Token(Token_Type type, const char* v, uint32_t off = 0) : token_type(type), offset(off), value(v), number(0) {}
+    Token(Token_Type type, const std::string& v, uint32_t off = 0)
+        : token_type(type), offset(off), value(v), number(0) {}
+    Token(Token_Type type, std::string&& v, uint32_t off = 0)
+        : token_type(type), offset(off), value(std::move(v)), number(0) {}
+    bool operator!=(const Token& t) const {
+        return (token_type != t.token_type) || (value.compare(t.value) != 0);
+    }
+    bool operator==(const Token& t) const {
+        return (token_type == t.token_type) && (value.compare(t.value) == 0);
+    }
+};
+struct Source {
+    const char* begin;
+    const char* next;
+    const char* end;
+    bool good;              // false once a read past 'end' was attempted
+    bool (*refill)();       // refills [next, end) when it runs dry, if set
+    size_t base;            // source offset of 'begin' (advances on refill)
+};
+struct Lexed_Token {
+    size_t offset;
+    Token token;
+};
+struct Lex_Run {
+    std::vector<Lexed_Token> tokens;
+    size_t exit;            // offset at which the next token would start
+    bool failed;            // stopped at a token Scan_Token() rejected
+    bool converged;         // stopped at a token start of the chunk's first run
+};
+// subc_node of subc.h, under the name the library uses for it
+typedef subc_node TreeNode;
+struct subc_node_impl {
+    int num_children;
+    subc_kind kind;
+    Token token;
+    uint64_t hash;          // Merkle hash of the subtree; see Hash_Node()
+    std::unique_ptr<TreeNode> left, right;
+    subc_node_impl(int n, subc_kind k, Token t, std::unique_ptr<TreeNode> l, std::unique_ptr<TreeNode> r)
+        : num_children(n), kind(k), token(std::move(t)), hash(0), left(std::move(l)), right(std::move(r)) {}
+    subc_node_impl(subc_node_impl&& other) = default;
+    ~subc_node_impl();
+};
+namespace subc {
+namespace detail {
+// Every node of each kind in the order they were built (children before
+// parents), and the same nodes keyed by name: a leaf by its text, any
+// other node by the text of its first child if that is an <identifier>.
+// SUBC_TEXT nodes are not listed.
+struct Node_Index {
+    std::vector<const TreeNode*> by_kind[SUBC_NUM_KINDS];
+    std::unordered_map<std::string, std::vector<const TreeNode*>> by_name[SUBC_NUM_KINDS];
+};
+// A node of a hash-consed tree. Structurally equal subtrees are built once,
+// so the tree is a DAG and two subtrees are equal iff their pointers are.
+struct Shared_Node {
+    const std::string* label; // interned in the pool
+    uint32_t offset;        // of the first occurrence
+    int num_children;
+    const Shared_Node* const* children;
+    size_t hash;
+};
+struct Shared_Node_Hash {
+    size_t operator()(const Shared_Node* n) const {
+        return n -> hash;
+    }
+};
+struct Shared_Node_Equal {
+    bool operator()(const Shared_Node* a, const Shared_Node* b) const {
+        return a -> label == b -> label && a -> num_children == b -> num_children &&
+               std::equal(a -> children, a -> children + a -> num_children, b -> children);
+    }
+};
+struct Node_Pool {
+    std::deque<Shared_Node> nodes;
+    std::vector<std::unique_ptr<const Shared_Node*[]>> slot_blocks; // children arrays
+    const Shared_Node** next_slot = nullptr;
+    size_t slots_left = 0;
+    size_t slot_bytes = 0;
+    std::unordered_set<std::string> labels;
+    std::unordered_set<const Shared_Node*, Shared_Node_Hash, Shared_Node_Equal> table;
+};
+}
+}
+using subc::detail::Node_Index;
+using subc::detail::Shared_Node;
+using subc::detail::Node_Pool;
+
+// A symbol of a production in the tables ll1gen generates from
+// docs/grammar.txt into subc_ll1.h, for Parse_Table_Source(). A terminal
+// or nonterminal is its number there. MARK notes where the trees of a
+// labeled production start on S, and the offset of the next token if
+// 'value' is 1; BUILD makes them, and 'extra' trees built before the mark,
+// into a node labeled LL1_Labels[value]. LEAVE is not in the tables: the
+// parser pushes it under a Statement or Primary to count its nesting.
+enum LL1_Op : uint8_t {
+    LL1_TERMINAL,
+    LL1_NONTERMINAL,
+    LL1_MARK,
+    LL1_BUILD,
+    LL1_LEAVE
+};
+struct LL1_Symbol {
+    LL1_Op op;
+    uint8_t extra;
+    uint16_t value;
+};
+
+
+#ifdef SUBC_PROFILE
+// Per-production counters of a profiling build. Inclusive time and tokens
+// count only a rule's outermost activation, so recursion is not counted
+// twice; exclusive time leaves out the rules it called.
+struct Rule_Stats {
+    uint64_t calls = 0;
+    uint64_t tokens = 0;
+    uint64_t inclusive_ns = 0;
+    uint64_t exclusive_ns = 0;
+    int active = 0;         // activations on the stack
+};
+struct Rule_Frame {
+    int rule;
+    uint64_t start_ns;
+    uint64_t child_ns;      // inclusive time of the rules it called
+    uint64_t tokens;        // Thread_Profile::tokens on entry
+};
+struct Trace_Event {
+    int rule;
+    uint64_t start_ns, duration_ns;
+};
+// One per thread that parsed, kept after the thread ends.
+struct Thread_Profile {
+    int id;
+    std::vector<Rule_Stats> rules;      // indexed by Register_Rule() ids
+    std::vector<Rule_Frame> frames;
+    uint64_t tokens = 0;                // scanned by Scan()
+    uint64_t builds[SUBC_NUM_KINDS] = {};
+    std::vector<Trace_Event> events;
+    uint64_t dropped_events = 0;        // past Max_Trace_Events
+};
+// Profiles the enclosing production for as long as it lives.
+struct Rule_Scope {
+    explicit Rule_Scope(int rule);
+    ~Rule_Scope();
+};
+#define PROFILE_RULE() static const int profile_rule = Register_Rule(__func__); \
+                       Rule_Scope profile_scope(profile_rule)
+#define PROFILE_TOKEN() Profile_Here() -> tokens++
+#define PROFILE_BUILD(kind) Profile_Here() -> builds[kind]++
+#else
+#define PROFILE_RULE()
+#define PROFILE_TOKEN()
+#define PROFILE_BUILD(kind)
+#endif
+
+
+/**************************** SCANNER FD ****************************/
+Token Scan();
+Token Scan_Token();
+Lex_Run Lex_Range(const char* begin, size_t len, size_t from, size_t stop, bool speculative,
+                  const Lex_Run* converge);
+long Find_Offset(const Lex_Run& run, size_t offset);
+std::vector<Token> Scan_All(const char* begin, size_t len, unsigned threads);
+void Check_Source_Size(size_t len);
+void Set_Source(const char* begin, size_t from, size_t to);
+void Set_Stream_Source();
+bool Refill_From_Stdin();
+void Get_Char();
+uint32_t Char_Offset();
+std::string Location(uint32_t offset);
+std::string Diagnostic(uint32_t offset, const std::string& msg);
+int64_t Decode_Integer(const std::string& digits, uint32_t offset);
+uint32_t Eight_Digits(const char* p);
+void Handle_Start_State(State& S, Token& t);
+void Handle_Identifier_State(State& S, Token& t);
+void Handle_Open_Curly_Bracket_State(State& S, Token& t);
+void Handle_Colon_State(State& S, Token& t);
+void Handle_Colon_Equals_State(State& S, Token& t);
+void Handle_Open_Angle_Bracket_State(State& S, Token& t);
+void Handle_Close_Angle_Bracket_State(State& S, Token& t);
+void Handle_Integer_State(State& S, Token& t);
+void Handle_Dot_State(State& S, Token& t);
+void Handle_Octothorpe_State(State& S, Token& t);
+void Handle_Open_Single_Quote_State(State& S, Token& t);
+void Handle_Open_Double_Quote_State(State& S, Token& t);
+
+
+
+/**************************** PARSER FD ****************************/
+std::unique_ptr<TreeNode> Parse_Source(Node_Index* index = nullptr, bool lazy = false);
+std::unique_ptr<TreeNode> Parse_Table_Source();
+int Table_Terminal(const Token& t);
+int Table_Nonterminal(const char* name);
+void Skip_Body();
+void Parse_Body(TreeNode* fcn, const char* begin, Node_Index* index);
+const Shared_Node* Parse_Shared_Source(Node_Pool& pool);
+const Shared_Node* Intern(const std::string& label, uint32_t offset, const Shared_Node* const* children, int n);
+void Read(const Token& t);
+void Build_Tree(subc_kind kind, int n, int64_t offset = -1);
+uint64_t Hash_Node(const TreeNode* n);
+uint64_t Hash_Bytes(uint64_t h, const char* p, size_t len);
+uint64_t Mix_Hash(uint64_t h);
+void Index_Node(const TreeNode* n);
+void Merge_Index(Node_Index& into, Node_Index& from);
+void Tiny();
+void Name();
+void Consts();
+void Const();
+void ConstValue();
+void Types();
+void Type();
+void LitList();
+void Dclns();
+void Dcln();
+void SubProgs();
+void Fcn();
+void Params();
+void Body();
+void Statement();
+void Assignment();
+void Expression();
+void Term();
+void Factor();
+void Primary();
+void OutExp();
+void StringNode();
+void ForStat();
+void ForExp();
+void Caseclause();
+void CaseExpression();
+void OtherwiseClause();
+int Parallel_Fcns();
+std::vector<size_t> Function_Offsets(const char* begin, const char* p, const char* end);
+
+
+
+#ifdef SUBC_PROFILE
+/**************************** PROFILER FD ****************************/
+int Register_Rule(const char* name);
+Thread_Profile* Profile_Here();
+uint64_t Profile_Now();
+void Start_Profile(bool trace);
+std::vector<std::string> Profile_Rule_Names();
+std::vector<const Thread_Profile*> Profile_Threads();
+#endif
+
+
+
+/**************************** GLOBALS ****************************/
+extern unsigned Parse_Threads;
+extern std::string Source_Name;
+extern void (*Function_Parsed)(std::unique_ptr<TreeNode> fcn);
+extern const char* Token_Type_Names[];
+extern const char* Kind_Names[];
+#ifdef SUBC_PROFILE
+extern const size_t Max_Trace_Events;
+#endif
+
+#endif
@@ -0,0 +1,94 @@
+/*
+ * Smoke test of libsubc's C API, built by script.bash against libsubc.so:
+ *   gcc tests/capi_smoke.c -L. -lsubc -Wl,-rpath,. -o capi_smoke
+ *   ./capi_smoke tests/tiny_01 | diff tests/tiny_01.tree -
+ *
+ * Prints the program's tree as 'p1 -ast' does, then checks errors, the
+ * kind index and lazy bodies. Exits 1 after the first check that fails.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../subc.h"
+
+static void check(int ok, const char* what) {
+    if (!ok) {
+        fprintf(stderr, "capi_smoke: %s\n", what);
+        exit(1);
+    }
+}
+
+static void print_tree(const subc_node* n, int depth) {
+    for (; n; n = subc_next_sibling(n)) {
+        int i;
+        for (i = 0; i < depth; i++)
+            fputs(". ", stdout);
+        printf("%s(%d)\n", subc_label(n, NULL), subc_num_children(n));
+        print_tree(subc_first_child(n), depth + 1);
+    }
+}
+
+static char* read_file(const char* path, size_t* len) {
+    FILE* f = fopen(path, "rb");
+    char* buf;
+    check(f != NULL, "cannot open the program");
+    fseek(f, 0, SEEK_END);
+    *len = (size_t) ftell(f);
+    rewind(f);
+    buf = malloc(*len + 1);
+    check(buf && fread(buf, 1, *len, f) == *len, "cannot read the program");
+    fclose(f);
+    return buf;
+}
+
+int main(int argc, char* argv[]) {
+    static const char bad[] = "program a:\nbegin\noutput(1 2)\nend a.\n";
+    static const char calls[] =
+        "program a:\nfunction f(n: integer): integer;\nbegin\nreturn (f(n) + g(n))\nend f;\n"
+        "begin\noutput(f(1), f('x'))\nend a.\n";
+    subc_ast* ast;
+    const subc_node* const* nodes;
+    const subc_node* fcn;
+    size_t len, count;
+    char* text;
+
+    check(argc == 2, "usage: capi_smoke path/to/testprog");
+    text = read_file(argv[1], &len);
+    ast = subc_parse(text, len);
+    check(subc_error(ast) == NULL, "a good program was rejected");
+    print_tree(subc_root(ast), 0);
+    check(subc_nodes(ast, SUBC_CALL, &count) == NULL && count == 0, "an unindexed tree has an index");
+    subc_free(ast);
+    free(text);
+
+    ast = subc_parse(bad, sizeof(bad) - 1);
+    check(subc_error(ast) != NULL && strncmp(subc_error(ast), "3:10: ", 6) == 0, "a bad program was not reported");
+    check(subc_root(ast) == NULL, "a bad program has a tree");
+    subc_free(ast);
+
+    /* Refused by its length alone, before any of the (short) buffer is read */
+    if (sizeof(size_t) > 4) {
+        ast = subc_parse(bad, (size_t) UINT32_MAX + 1);
+        check(subc_error(ast) != NULL && strstr(subc_error(ast), "over the limit") != NULL,
+              "a source over 4 GiB was not refused");
+        subc_free(ast);
+    }
+
+    ast = subc_parse_indexed(calls, sizeof(calls) - 1);
+    check(subc_error(ast) == NULL, "the indexed program was rejected");
+    nodes = subc_nodes_named(ast, SUBC_CALL, "f", &count);
+    check(nodes != NULL && count == 3, "subc_nodes_named did not find the 3 calls to f");
+    check(subc_node_kind(nodes[0]) == SUBC_CALL, "subc_nodes_named returned a node of another kind");
+    nodes = subc_nodes_named(ast, SUBC_CALL, "h", &count);
+    check(nodes == NULL && count == 0, "subc_nodes_named found calls to h");
+    subc_free(ast);
+
+    ast = subc_parse_options(calls, sizeof(calls) - 1, SUBC_LAZY_BODIES);
+    fcn = subc_first_child(subc_next_sibling(subc_next_sibling(subc_next_sibling(subc_next_sibling(
+              subc_first_child(subc_root(ast)))))));
+    check(subc_error(ast) == NULL && subc_node_kind(fcn) == SUBC_FCN, "the lazy program has no function");
+    check(subc_expand(ast, fcn) == NULL, "the function's body did not expand");
+    check(subc_num_children(fcn) == 8, "the expanded function does not have 8 children");
+    subc_free(ast);
+    return 0;
+}
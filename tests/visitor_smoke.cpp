@@ -0,0 +1,38 @@
+// Smoke test of subc::Visitor, built by script.bash against libsubc.so:
+//   g++ -std=c++11 tests/visitor_smoke.cpp -L. -lsubc -Wl,-rpath,. -o visitor_smoke
+//   ./visitor_smoke tests/tiny_01
+//
+// Counts the program's calls and functions by dispatching on kind, and
+// prints "<calls> <functions>"; script.bash compares the calls with
+// 'p1 -find call'. A call's arguments may hold calls, so its handler goes
+// on into its children.
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include "../subc.h"
+
+int main(int argc, char* argv[]) {
+    if (argc != 2) {
+        std::cerr << "usage: visitor_smoke path/to/testprog" << std::endl;
+        return 1;
+    }
+    std::ifstream in(argv[1], std::ios::binary);
+    std::stringstream text;
+    text << in.rdbuf();
+    std::string source = text.str();
+    subc::Ast ast = subc::parse(source.data(), source.size());
+
+    int calls = 0, functions = 0;
+    subc::Visitor v;
+    v.on(SUBC_CALL, [&](subc::Node n) {
+        calls++;
+        v.visit_children(n);
+    });
+    v.on(SUBC_FCN, [&](subc::Node n) {
+        functions++;
+        v.visit_children(n);
+    });
+    v.visit(ast.root());
+    std::cout << calls << " " << functions << std::endl;
+    return 0;
+}